@@ -0,0 +1,114 @@
+#include <string.h>
+
+#include "array_sort.h"
+
+/* Blocks of this many slots are sorted by insertion before merging */
+#define ARRAY_SORT_BLOCK 32
+
+static inline int slot_cmp(void *priv,
+                           list_cmp_func_t cmp,
+                           bool descend,
+                           const sort_slot_t *a,
+                           const sort_slot_t *b)
+{
+    if (a->key != b->key)
+        return (a->key < b->key) != descend ? -1 : 1;
+    return cmp(priv, a->node, b->node);
+}
+
+/* Binary insertion sort, so that reversed input costs O(n log n) comparisons
+ * rather than O(n^2). Each slot goes after the ones equal to it, for
+ * stability, and one already in place costs a single comparison.
+ */
+static void insertion_sort(void *priv,
+                           list_cmp_func_t cmp,
+                           bool descend,
+                           sort_slot_t *slots,
+                           size_t n)
+{
+    for (size_t i = 1; i < n; i++) {
+        if (slot_cmp(priv, cmp, descend, &slots[i - 1], &slots[i]) <= 0)
+            continue;
+        sort_slot_t tmp = slots[i];
+        size_t lo = 0, hi = i - 1;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (slot_cmp(priv, cmp, descend, &slots[mid], &tmp) > 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        memmove(&slots[lo + 1], &slots[lo], (i - lo) * sizeof(*slots));
+        slots[lo] = tmp;
+    }
+}
+
+/* Merge the sorted ranges src[lo, mid) and src[mid, hi) into dst[lo, hi) */
+static void merge_slots(void *priv,
+                        list_cmp_func_t cmp,
+                        bool descend,
+                        const sort_slot_t *src,
+                        sort_slot_t *dst,
+                        size_t lo,
+                        size_t mid,
+                        size_t hi)
+{
+    size_t i = lo, j = mid, k = lo;
+
+    while (i < mid && j < hi) {
+        /* if equal, take the left one -- important for sort stability */
+        if (slot_cmp(priv, cmp, descend, &src[i], &src[j]) <= 0)
+            dst[k++] = src[i++];
+        else
+            dst[k++] = src[j++];
+    }
+    while (i < mid)
+        dst[k++] = src[i++];
+    while (j < hi)
+        dst[k++] = src[j++];
+}
+
+void array_sort(void *priv,
+                struct list_head *head,
+                list_cmp_func_t cmp,
+                list_key_func_t key,
+                bool descend,
+                sort_slot_t *scratch,
+                size_t n)
+{
+    if (n < 2)
+        return;
+
+    sort_slot_t *src = scratch, *dst = scratch + n;
+    struct list_head *node = head->next;
+    for (size_t i = 0; i < n; i++, node = node->next) {
+        src[i].key = key(node);
+        src[i].node = node;
+    }
+
+    for (size_t lo = 0; lo < n; lo += ARRAY_SORT_BLOCK) {
+        size_t len = n - lo < ARRAY_SORT_BLOCK ? n - lo : ARRAY_SORT_BLOCK;
+        insertion_sort(priv, cmp, descend, src + lo, len);
+    }
+
+    for (size_t width = ARRAY_SORT_BLOCK; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            merge_slots(priv, cmp, descend, src, dst, lo, mid, hi);
+        }
+        sort_slot_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    /* Relink the list in array order */
+    struct list_head *prev = head;
+    for (size_t i = 0; i < n; i++) {
+        prev->next = src[i].node;
+        src[i].node->prev = prev;
+        prev = src[i].node;
+    }
+    prev->next = head;
+    head->prev = prev;
+}
@@ -0,0 +1,47 @@
+#ifndef LAB0_ARRAYSORT_H
+#define LAB0_ARRAYSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "list.h"
+#include "list_sort.h"
+
+/* Return an order-preserving 64-bit prefix of the key of a list node: if
+ * key(a) < key(b), then a sorts before b in ascending order.
+ */
+typedef uint64_t (*list_key_func_t)(const struct list_head *);
+
+/* Entry of the scratch array used by array_sort() */
+typedef struct {
+    uint64_t key;
+    struct list_head *node;
+} sort_slot_t;
+
+/**
+ * array_sort - stable sort through a contiguous array of (key, node) pairs
+ * @priv: private data, opaque to array_sort(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: comparator for nodes with equal keys, must agree with @descend
+ * @key: returns the key prefix of a node
+ * @descend: whether to sort in descending order
+ * @scratch: buffer of at least 2 * @n slots
+ * @n: number of nodes in @head
+ *
+ * The nodes are gathered into @scratch together with their key prefix, so
+ * that most comparisons touch the array alone. The array is sorted by
+ * insertion sort on small blocks followed by bottom-up merge passes, which
+ * alternate between the two halves of @scratch and read memory
+ * sequentially. Finally the list is relinked in one pass. @scratch is
+ * provided by the caller, so nothing is allocated here.
+ */
+void array_sort(void *priv,
+                struct list_head *head,
+                list_cmp_func_t cmp,
+                list_key_func_t key,
+                bool descend,
+                sort_slot_t *scratch,
+                size_t n);
+
+#endif
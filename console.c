@@ -93,6 +93,16 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
 
 /* Add a new parameter */
 void add_param(char *name, int *valp, char *summary, setter_func_t setter)
+{
+    add_param_choices(name, valp, summary, setter, NULL);
+}
+
+/* Add a new parameter whose values can also be set by name */
+void add_param_choices(char *name,
+                       int *valp,
+                       char *summary,
+                       setter_func_t setter,
+                       const char *const *choices)
 {
     param_element_t *next_param = param_list;
     param_element_t **last_loc = &param_list;
@@ -107,6 +117,7 @@ void add_param(char *name, int *valp, char *summary, setter_func_t setter)
     param->valp = valp;
     param->summary = summary;
     param->setter = setter;
+    param->choices = choices;
     param->next = next_param;
     *last_loc = param;
 }
@@ -250,6 +261,40 @@ static bool do_quit(int argc, char *argv[])
     return ok;
 }
 
+/* Number of named values of a parameter */
+static int param_choice_cnt(const param_element_t *p)
+{
+    int cnt = 0;
+    while (p->choices && p->choices[cnt])
+        cnt++;
+    return cnt;
+}
+
+static void report_param(const param_element_t *p)
+{
+    int val = *p->valp;
+    if (val >= 0 && val < param_choice_cnt(p))
+        report(1, "  %-12s%-12s | %s", p->name, p->choices[val], p->summary);
+    else
+        report(1, "  %-12s%-12d | %s", p->name, val, p->summary);
+}
+
+/* Parse the value of parameter p, either as an integer or by name */
+static bool get_param_value(const param_element_t *p, char *vname, int *loc)
+{
+    int cnt = param_choice_cnt(p);
+    for (int i = 0; i < cnt; i++) {
+        if (!strcmp(p->choices[i], vname)) {
+            *loc = i;
+            return true;
+        }
+    }
+
+    if (!get_int(vname, loc))
+        return false;
+    return !cnt || (*loc >= 0 && *loc < cnt);
+}
+
 static bool do_help(int argc, char *argv[])
 {
     cmd_element_t *clist = cmd_list;
@@ -262,8 +307,7 @@ static bool do_help(int argc, char *argv[])
     param_element_t *plist = param_list;
     report(1, "Options:");
     while (plist) {
-        report(1, "  %-12s%-12d | %s", plist->name, *plist->valp,
-               plist->summary);
+        report_param(plist);
         plist = plist->next;
     }
     return true;
@@ -301,8 +345,7 @@ static bool do_option(int argc, char *argv[])
         param_element_t *plist = param_list;
         report(1, "Options:");
         while (plist) {
-            report(1, "  %-12s%-12d | %s", plist->name, *plist->valp,
-                   plist->summary);
+            report_param(plist);
             plist = plist->next;
         }
         return true;
@@ -312,18 +355,24 @@ static bool do_option(int argc, char *argv[])
         char *name = argv[i];
         int value = 0;
         bool found = false;
-        /* Get value from next argument */
+        /* Value is given by next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
             return false;
-        } else if (!get_int(argv[++i], &value)) {
-            report(1, "Cannot parse '%s' as integer", argv[i]);
-            return false;
         }
+        i++;
         /* Find parameter in list */
         param_element_t *plist = param_list;
         while (!found && plist) {
             if (strcmp(plist->name, name) == 0) {
+                if (!get_param_value(plist, argv[i], &value)) {
+                    if (plist->choices)
+                        report(1, "Invalid value '%s' for parameter %s",
+                               argv[i], name);
+                    else
+                        report(1, "Cannot parse '%s' as integer", argv[i]);
+                    return false;
+                }
                 int oldval = *plist->valp;
                 *plist->valp = value;
                 if (plist->setter)
@@ -442,6 +491,8 @@ void init_cmd()
     add_param("error", &err_limit, "Number of errors until exit", NULL);
     add_param("echo", &echo, "Do/don't echo commands", NULL);
     add_param("entropy", &show_entropy, "Show/Hide Shannon entropy", NULL);
+    add_param("mblimit", &mblimit, "Memory limit in megabytes (0 = unlimited)",
+              NULL);
 
     init_in();
     init_time(&last_time);
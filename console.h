@@ -37,6 +37,8 @@ typedef struct __param_element {
     char *summary;
     /* Function that gets called whenever parameter changes */
     setter_func_t setter;
+    /* Optional NULL-terminated names for the values 0, 1, 2, ... */
+    const char *const *choices;
     struct __param_element *next;
 } param_element_t;
 
@@ -50,6 +52,15 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *parameter);
 /* Add a new parameter */
 void add_param(char *name, int *valp, char *summary, setter_func_t setter);
 
+/* Add a new parameter whose values can also be set by name.
+ * choices[i] names value i, and the array is terminated by NULL.
+ */
+void add_param_choices(char *name,
+                       int *valp,
+                       char *summary,
+                       setter_func_t setter,
+                       const char *const *choices);
+
 /* Extract integer from text and store at loc */
 bool get_int(char *vname, int *loc);
 
@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Nodes are shared between threads, bypass the test harness */
+#define INTERNAL 1
+#include "cqueue.h"
+
+cqueue_t *cq_new(void)
+{
+    cqueue_t *q = malloc(sizeof(cqueue_t));
+    cq_node_t *dummy = malloc(sizeof(cq_node_t));
+    if (!q || !dummy) {
+        free(q);
+        free(dummy);
+        return NULL;
+    }
+
+    memset(q, 0, sizeof(cqueue_t));
+    atomic_init(&dummy->next, NULL);
+    dummy->elem = NULL;
+    atomic_init(&q->head, dummy);
+    atomic_init(&q->tail, dummy);
+    atomic_init(&q->size, 0);
+    return q;
+}
+
+void cq_release_element(element_t *e)
+{
+    free(e);
+}
+
+void cq_free(cqueue_t *q)
+{
+    if (!q)
+        return;
+
+    for (int i = 0; i < CQ_MAX_THREADS; i++) {
+        cq_thread_t *t = &q->threads[i];
+        for (int j = 0; j < t->nretired; j++)
+            free(t->retired[j]);
+    }
+
+    /* The head is the dummy node, its element was handed out already */
+    cq_node_t *node = atomic_load(&q->head);
+    for (bool dummy = true; node; dummy = false) {
+        cq_node_t *next = atomic_load(&node->next);
+        if (!dummy)
+            cq_release_element(node->elem);
+        free(node);
+        node = next;
+    }
+    free(q);
+}
+
+/* Publish the pointer read from src in hazard slot hp, and retry until src
+ * still holds it afterwards, so the node cannot have been retired in
+ * between.
+ */
+static cq_node_t *cq_protect(_Atomic(cq_node_t *) *src,
+                             _Atomic(cq_node_t *) *hp)
+{
+    cq_node_t *p = atomic_load(src), *check;
+    for (;;) {
+        atomic_store(hp, p);
+        check = atomic_load(src);
+        if (check == p)
+            return p;
+        p = check;
+    }
+}
+
+static bool cq_hazardous(cqueue_t *q, const cq_node_t *node)
+{
+    for (int i = 0; i < CQ_MAX_THREADS; i++) {
+        for (int j = 0; j < CQ_HAZARDS; j++) {
+            if (atomic_load(&q->threads[i].hazard[j]) == node)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Defer freeing a node removed from the queue until no hazard pointer
+ * refers to it. At most CQ_HAZARDS * CQ_MAX_THREADS nodes survive a scan,
+ * so the retired list never overflows.
+ */
+static void cq_retire(cqueue_t *q, int tid, cq_node_t *node)
+{
+    cq_thread_t *t = &q->threads[tid];
+    t->retired[t->nretired++] = node;
+    if (t->nretired < CQ_RETIRE_MAX)
+        return;
+
+    int kept = 0;
+    for (int i = 0; i < t->nretired; i++) {
+        if (cq_hazardous(q, t->retired[i]))
+            t->retired[kept++] = t->retired[i];
+        else
+            free(t->retired[i]);
+    }
+    t->nretired = kept;
+}
+
+bool cq_insert_tail(cqueue_t *q, int tid, const char *s)
+{
+    if (!q)
+        return false;
+
+    size_t len = strlen(s);
+    element_t *e = malloc(sizeof(element_t) + len + 1);
+    cq_node_t *node = malloc(sizeof(cq_node_t));
+    if (!e || !node) {
+        free(e);
+        free(node);
+        return false;
+    }
+    memcpy(e->data, s, len + 1);
+    e->value = e->data;
+    e->key = q_key_prefix(e->value);
+    INIT_LIST_HEAD(&e->list);
+    node->elem = e;
+    atomic_init(&node->next, NULL);
+
+    _Atomic(cq_node_t *) *hp = &q->threads[tid].hazard[0];
+    cq_node_t *tail;
+    for (;;) {
+        tail = cq_protect(&q->tail, hp);
+        cq_node_t *next = atomic_load(&tail->next);
+        if (tail != atomic_load(&q->tail))
+            continue;
+        if (next) {
+            /* Tail is lagging behind, help to swing it */
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&tail->next, &next, node))
+            break;
+    }
+    atomic_compare_exchange_strong(&q->tail, &tail, node);
+    atomic_store(hp, NULL);
+    atomic_fetch_add(&q->size, 1);
+    return true;
+}
+
+element_t *cq_remove_head(cqueue_t *q, int tid, char *sp, size_t bufsize)
+{
+    if (!q)
+        return NULL;
+
+    _Atomic(cq_node_t *) *hp = q->threads[tid].hazard;
+    cq_node_t *head;
+    element_t *e;
+    for (;;) {
+        head = cq_protect(&q->head, &hp[0]);
+        cq_node_t *tail = atomic_load(&q->tail);
+        cq_node_t *next = cq_protect(&head->next, &hp[1]);
+        if (head != atomic_load(&q->head))
+            continue;
+        if (!next) {
+            atomic_store(&hp[0], NULL);
+            atomic_store(&hp[1], NULL);
+            return NULL;
+        }
+        if (head == tail) {
+            atomic_compare_exchange_weak(&q->tail, &tail, next);
+            continue;
+        }
+        /* Only the thread whose CAS succeeds owns the element */
+        e = next->elem;
+        if (atomic_compare_exchange_weak(&q->head, &head, next))
+            break;
+    }
+    atomic_store(&hp[0], NULL);
+    atomic_store(&hp[1], NULL);
+    cq_retire(q, tid, head);
+    atomic_fetch_sub(&q->size, 1);
+
+    if (sp && bufsize) {
+        strncpy(sp, e->value, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    return e;
+}
+
+long cq_size(cqueue_t *q)
+{
+    return q ? atomic_load(&q->size) : 0;
+}
@@ -0,0 +1,107 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/* Concurrent queue
+ *
+ * A lock-free multi-producer, multi-consumer FIFO of element_t strings,
+ * after Michael and Scott, "Simple, Fast, and Practical Non-Blocking and
+ * Blocking Concurrent Queue Algorithms" (PODC 1996). Removed nodes are
+ * reclaimed with hazard pointers (Michael, "Hazard Pointers: Safe Memory
+ * Reclamation for Lock-Free Objects", IEEE TPDS 2004).
+ *
+ * Each thread using a queue passes its own slot number @tid, between 0 and
+ * CQ_MAX_THREADS - 1, which indexes its hazard pointers and retired list.
+ * Memory comes from the system allocator: the test harness is not thread
+ * safe.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+#define CQ_MAX_THREADS 64
+
+/* Hazard pointers per thread: the head or tail, and the node after head */
+#define CQ_HAZARDS 2
+
+/* Retired nodes a thread keeps before scanning the hazard pointers */
+#define CQ_RETIRE_MAX (2 * CQ_HAZARDS * CQ_MAX_THREADS)
+
+#define CQ_CACHELINE 64
+
+typedef struct cq_node {
+    _Atomic(struct cq_node *) next;
+    element_t *elem;
+} cq_node_t;
+
+typedef struct {
+    _Alignas(CQ_CACHELINE) _Atomic(cq_node_t *) hazard[CQ_HAZARDS];
+    cq_node_t *retired[CQ_RETIRE_MAX];
+    int nretired;
+} cq_thread_t;
+
+typedef struct {
+    /* head and tail are written by different threads, keep them apart */
+    _Alignas(CQ_CACHELINE) _Atomic(cq_node_t *) head;
+    _Alignas(CQ_CACHELINE) _Atomic(cq_node_t *) tail;
+    _Alignas(CQ_CACHELINE) atomic_long size;
+    cq_thread_t threads[CQ_MAX_THREADS];
+} cqueue_t;
+
+/**
+ * cq_new() - Create an empty concurrent queue
+ *
+ * Return: NULL for allocation failed
+ */
+cqueue_t *cq_new(void);
+
+/**
+ * cq_free() - Free all storage used by a concurrent queue
+ * @q: queue to free, no other thread may still be using it
+ */
+void cq_free(cqueue_t *q);
+
+/**
+ * cq_insert_tail() - Insert a copy of @s at the tail, lock-free
+ * @q: concurrent queue
+ * @tid: slot number of the calling thread
+ * @s: string to be copied and inserted
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool cq_insert_tail(cqueue_t *q, int tid, const char *s);
+
+/**
+ * cq_remove_head() - Remove the element at the head, lock-free
+ * @q: concurrent queue
+ * @tid: slot number of the calling thread
+ * @sp: string would be inserted
+ * @bufsize: size of the string
+ *
+ * Like q_remove_head(), the removed string is copied to @sp if it is
+ * non-NULL. The element belongs to the caller, who releases it with
+ * cq_release_element().
+ *
+ * Return: the removed element, NULL if the queue is NULL or empty
+ */
+element_t *cq_remove_head(cqueue_t *q, int tid, char *sp, size_t bufsize);
+
+/**
+ * cq_release_element() - Release an element returned by cq_remove_head()
+ * @e: element to release
+ */
+void cq_release_element(element_t *e);
+
+/**
+ * cq_size() - Get the number of elements in the queue
+ * @q: concurrent queue
+ *
+ * The value is exact only while no other thread modifies the queue.
+ *
+ * Return: the number of elements in queue, zero if queue is NULL or empty
+ */
+long cq_size(cqueue_t *q);
+
+#endif /* LAB0_CQUEUE_H */
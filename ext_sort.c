@@ -0,0 +1,284 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Merge buffers are accounted by report.c, not by the test harness */
+#define INTERNAL 1
+#include "ext_sort.h"
+#include "list_sort.h"
+#include "queue.h"
+#include "report.h"
+
+typedef struct {
+    char dir[256]; /* Temporary directory holding the runs */
+    bool descend;
+} ext_ctx_t;
+
+/* Reader of one run file */
+typedef struct {
+    FILE *fp;
+    char *buf; /* Current string */
+    size_t cap;
+    size_t len;
+} run_cursor_t;
+
+/* Consumer of the merged strings */
+typedef bool (*emit_func_t)(void *arg, const char *s, size_t len);
+
+static void run_path(const ext_ctx_t *ctx, size_t id, char *path, size_t size)
+{
+    snprintf(path, size, "%s/run-%zu", ctx->dir, id);
+}
+
+static int elem_cmp(void *priv,
+                    const struct list_head *a,
+                    const struct list_head *b)
+{
+    int res = q_element_cmp(list_entry(a, element_t, list),
+                            list_entry(b, element_t, list));
+    return *(bool *) priv ? -res : res;
+}
+
+static bool write_record(FILE *fp, const char *s, size_t len)
+{
+    uint32_t n = len;
+    return fwrite(&n, sizeof(n), 1, fp) == 1 && fwrite(s, 1, len, fp) == len;
+}
+
+static bool emit_record(void *arg, const char *s, size_t len)
+{
+    return write_record(arg, s, len);
+}
+
+static bool emit_line(void *arg, const char *s, size_t len)
+{
+    return fwrite(s, 1, len, arg) == len && fputc('\n', arg) != EOF;
+}
+
+static bool emit_queue(void *arg, const char *s, size_t len)
+{
+    (void) len;
+    return q_insert_tail(arg, (char *) s);
+}
+
+/* Load the next string of the run, false at its end */
+static bool cursor_next(run_cursor_t *c)
+{
+    uint32_t n;
+    if (fread(&n, sizeof(n), 1, c->fp) != 1)
+        return false;
+    if (n >= c->cap) {
+        char *buf = malloc_or_fail(n + 1, "ext_sort");
+        if (c->buf)
+            free_block(c->buf, c->cap);
+        c->buf = buf;
+        c->cap = n + 1;
+    }
+    if (fread(c->buf, 1, n, c->fp) != n)
+        return false;
+    c->buf[n] = '\0';
+    c->len = n;
+    return true;
+}
+
+/* Whether cursor i goes before cursor j. Earlier runs win ties. */
+static bool cursor_before(const ext_ctx_t *ctx,
+                          const run_cursor_t *cur,
+                          size_t i,
+                          size_t j)
+{
+    int res = strcmp(cur[i].buf, cur[j].buf);
+    if (ctx->descend)
+        res = -res;
+    return res < 0 || (!res && i < j);
+}
+
+static void sift_down(const ext_ctx_t *ctx,
+                      const run_cursor_t *cur,
+                      size_t *heap,
+                      size_t n,
+                      size_t i)
+{
+    for (;;) {
+        size_t min = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && cursor_before(ctx, cur, heap[l], heap[min]))
+            min = l;
+        if (r < n && cursor_before(ctx, cur, heap[r], heap[min]))
+            min = r;
+        if (min == i)
+            return;
+        size_t tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+static void remove_runs(const ext_ctx_t *ctx, size_t lo, size_t hi)
+{
+    char path[sizeof(ctx->dir) + 32];
+    for (size_t id = lo; id < hi; id++) {
+        run_path(ctx, id, path, sizeof(path));
+        unlink(path);
+    }
+}
+
+/* k-way merge of runs lo .. hi - 1 into emit. Everything is emitted even
+ * after emit fails, to lose as little as possible.
+ */
+static bool merge_runs(const ext_ctx_t *ctx,
+                       size_t lo,
+                       size_t hi,
+                       emit_func_t emit,
+                       void *arg)
+{
+    size_t k = hi - lo, n = 0;
+    run_cursor_t *cur = calloc_or_fail(k, sizeof(*cur), "ext_sort");
+    size_t *heap = malloc_or_fail(k * sizeof(*heap), "ext_sort");
+    char path[sizeof(ctx->dir) + 32];
+    bool ok = true;
+
+    for (size_t i = 0; i < k; i++) {
+        run_path(ctx, lo + i, path, sizeof(path));
+        cur[i].fp = fopen(path, "rb");
+        if (!cur[i].fp)
+            ok = false;
+        else if (cursor_next(&cur[i]))
+            heap[n++] = i;
+    }
+    for (size_t i = n / 2; i-- > 0;)
+        sift_down(ctx, cur, heap, n, i);
+
+    while (n) {
+        run_cursor_t *c = &cur[heap[0]];
+        ok = emit(arg, c->buf, c->len) && ok;
+        if (!cursor_next(c))
+            heap[0] = heap[--n];
+        sift_down(ctx, cur, heap, n, 0);
+    }
+
+    for (size_t i = 0; i < k; i++) {
+        if (cur[i].fp) {
+            ok = !ferror(cur[i].fp) && ok;
+            fclose(cur[i].fp);
+        }
+        if (cur[i].buf)
+            free_block(cur[i].buf, cur[i].cap);
+    }
+    free_array(cur, k, sizeof(*cur));
+    free_block(heap, k * sizeof(*heap));
+    return ok;
+}
+
+/* Merge runs lo .. hi - 1 into the new run id */
+static bool merge_to_run(const ext_ctx_t *ctx, size_t lo, size_t hi, size_t id)
+{
+    char path[sizeof(ctx->dir) + 32];
+    run_path(ctx, id, path, sizeof(path));
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return false;
+
+    bool ok = merge_runs(ctx, lo, hi, emit_record, fp);
+    ok = !fclose(fp) && ok;
+    if (ok)
+        remove_runs(ctx, lo, hi);
+    else
+        unlink(path);
+    return ok;
+}
+
+/* Cut the queue into sorted runs 0 .. *runs - 1. On failure the unwritten
+ * elements stay in the queue.
+ */
+static bool spill_runs(const ext_ctx_t *ctx,
+                       struct list_head *head,
+                       size_t budget,
+                       size_t *runs)
+{
+    char path[sizeof(ctx->dir) + 32];
+
+    while (!list_empty(head)) {
+        /* Take as many leading elements as fit in budget, at least one */
+        struct list_head *node, *last = head->next;
+        size_t bytes = 0, count = 0;
+        list_for_each (node, head) {
+            element_t *e = list_entry(node, element_t, list);
+            bytes += sizeof(*e) + strlen(e->value) + 1;
+            if (bytes > budget && count)
+                break;
+            last = node;
+            count++;
+        }
+
+        LIST_HEAD(chunk);
+        list_cut_position(&chunk, head, last);
+        list_sort((void *) &ctx->descend, &chunk, elem_cmp);
+        list_splice(&chunk, head);
+
+        run_path(ctx, *runs, path, sizeof(path));
+        FILE *fp = fopen(path, "wb");
+        if (!fp)
+            return false;
+        bool ok = true;
+        node = head->next;
+        for (size_t i = 0; ok && i < count; i++, node = node->next) {
+            const char *s = list_entry(node, element_t, list)->value;
+            ok = write_record(fp, s, strlen(s));
+        }
+        ok = !fclose(fp) && ok;
+        if (!ok) {
+            unlink(path);
+            return false;
+        }
+
+        /* Only now that the run is safe on disk */
+        while (count--)
+            q_release_element(q_remove_head(head, NULL, 0));
+        (*runs)++;
+    }
+    return true;
+}
+
+bool ext_sort(struct list_head *head, bool descend, size_t budget, FILE *out)
+{
+    if (!head)
+        return false;
+
+    ext_ctx_t ctx = {.descend = descend};
+    const char *tmpdir = getenv("TMPDIR");
+    if (!tmpdir || !*tmpdir)
+        tmpdir = "/tmp";
+    if (snprintf(ctx.dir, sizeof(ctx.dir), "%s/lab0-sort-XXXXXX", tmpdir) >=
+            (int) sizeof(ctx.dir) ||
+        !mkdtemp(ctx.dir))
+        return false;
+
+    size_t lo = 0, hi = 0;
+    bool ok = spill_runs(&ctx, head, budget, &hi);
+
+    /* Merge consecutive runs level by level, so that ties stay in order */
+    while (ok && hi - lo > EXT_SORT_FANIN) {
+        size_t end = hi;
+        while (ok && lo < end) {
+            size_t n = end - lo < EXT_SORT_FANIN ? end - lo : EXT_SORT_FANIN;
+            ok = merge_to_run(&ctx, lo, lo + n, hi);
+            if (ok) {
+                lo += n;
+                hi++;
+            }
+        }
+    }
+
+    bool done = false;
+    if (ok && out && lo < hi)
+        done = ok = merge_runs(&ctx, lo, hi, emit_line, out);
+    /* After a failure, still bring every element back into the queue */
+    if (!done && lo < hi)
+        ok = merge_runs(&ctx, lo, hi, emit_queue, head) && ok;
+
+    remove_runs(&ctx, lo, hi);
+    rmdir(ctx.dir);
+    return ok;
+}
@@ -0,0 +1,34 @@
+#ifndef LAB0_EXTSORT_H
+#define LAB0_EXTSORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "list.h"
+
+/* Maximum number of runs merged at once, bounding the open files */
+#define EXT_SORT_FANIN 16
+
+/**
+ * ext_sort - sort a queue through run files on disk
+ * @head: header of the queue to sort
+ * @descend: whether to sort in descending order
+ * @budget: bytes of elements to sort in memory at once
+ * @out: if not NULL, the file to write the sorted strings to, one per line
+ *
+ * The queue is cut into chunks of at most @budget bytes of elements, each of
+ * which is sorted with list_sort() and written as a run of length-prefixed
+ * strings to a directory under $TMPDIR, releasing its elements. The runs are
+ * then merged EXT_SORT_FANIN at a time until few enough are left for a final
+ * k-way merge, which inserts the strings back into the queue, or writes them
+ * to @out and leaves the queue empty. The sort is stable. Merge buffers are
+ * allocated through report.c and count against mblimit.
+ *
+ * Return: true on success. On an I/O error the elements are merged back into
+ * the queue, though no longer in order. Elements which q_insert_tail() fails
+ * to reinsert are lost.
+ */
+bool ext_sort(struct list_head *head, bool descend, size_t budget, FILE *out);
+
+#endif
@@ -2,6 +2,8 @@
 
 #include <setjmp.h>
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,23 +31,71 @@
 
 /* Data structures used by our code */
 
-/* Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
+/* Every block starts with this header. Live blocks are tracked by the hash
+ * index below, so next is only used to link free slots of a slab chunk.
  */
 typedef struct __block_element {
-    struct __block_element *next, *prev;
+    struct __block_element *next;
+    struct __slab_chunk *chunk; /* Owning slab chunk, NULL if from malloc */
     size_t payload_size;
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
-static block_element_t *allocated = NULL;
+_Static_assert(sizeof(block_element_t) % _Alignof(max_align_t) == 0,
+               "block header must keep the payload aligned");
+
 static size_t allocated_count = 0;
 
+/* Index of live blocks: open addressing with linear probing, keyed by block
+ * address. It keeps validation in cautious mode O(1) per free instead of a
+ * scan over every allocated block.
+ */
+#define LIVE_INDEX_MIN_BITS 10
+static block_element_t **live_slots = NULL;
+static size_t live_bits = 0;
+
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
+int alloc_mode = ALLOC_SYSTEM;
+
+/* Slab arena: blocks whose payload fits one of the size classes are carved
+ * from large chunks instead of being allocated one by one. Each chunk serves
+ * a single class and goes back to the system as soon as its last block is
+ * freed.
+ *
+ * The chunks are shared by all queues: test_malloc() cannot tell which queue
+ * a block is for, and elements move between queues in q_merge(). q_free()
+ * therefore still releases a queue one block at a time through test_free(),
+ * and only the size-class pooling is gained.
+ */
+static const size_t slab_class_size[] = {32, 48, 64, 96, 128, 192, 256};
+#define N_SLAB_CLASS (sizeof(slab_class_size) / sizeof(slab_class_size[0]))
+
+/* Bytes requested from the system for every chunk */
+#define SLAB_CHUNK_SIZE (64 * 1024)
+
+/* Slots keep the payload alignment that malloc() guarantees. The header is a
+ * multiple of it, so aligning the slots aligns the payloads.
+ */
+#define SLAB_ALIGN _Alignof(max_align_t)
+
+typedef struct __slab_chunk {
+    /* Chunks of the same class that still have free slots */
+    struct __slab_chunk *next, *prev;
+    block_element_t *free_slots; /* Freed slots, linked by their next field */
+    size_t used;                 /* Number of slots handed out */
+    size_t carved;               /* Number of slots ever handed out */
+    size_t nslots;
+    size_t slot_size;
+    size_t cls;
+    _Alignas(SLAB_ALIGN) unsigned char slots[];
+} slab_chunk_t;
+
+static slab_chunk_t *slab_partial[N_SLAB_CLASS];
+
 static bool cautious_mode = true;
 static bool noallocate_mode = false;
 static bool error_occurred = false;
@@ -67,6 +117,75 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+static inline size_t live_hash(const block_element_t *b)
+{
+    /* Fibonacci hashing spreads the aligned addresses over the table */
+    return (size_t) (((uint64_t) (uintptr_t) b * 0x9E3779B97F4A7C15ULL) >>
+                     (64 - live_bits));
+}
+
+/* Find the slot holding b, or the empty slot where it would go */
+static size_t live_find(const block_element_t *b)
+{
+    size_t mask = ((size_t) 1 << live_bits) - 1;
+    size_t i = live_hash(b);
+    while (live_slots[i] && live_slots[i] != b)
+        i = (i + 1) & mask;
+    return i;
+}
+
+/* Keep the load factor at most one half, rehashing into a larger table */
+static bool live_reserve(size_t count)
+{
+    if (live_slots && count <= ((size_t) 1 << live_bits) / 2)
+        return true;
+
+    size_t old_cap = live_slots ? (size_t) 1 << live_bits : 0;
+    size_t bits = live_bits ? live_bits + 1 : LIVE_INDEX_MIN_BITS;
+    block_element_t **old_slots = live_slots;
+    live_slots = calloc((size_t) 1 << bits, sizeof(block_element_t *));
+    if (!live_slots) {
+        live_slots = old_slots;
+        return false;
+    }
+
+    live_bits = bits;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old_slots[i])
+            live_slots[live_find(old_slots[i])] = old_slots[i];
+    }
+    free(old_slots);
+    return true;
+}
+
+static bool live_contains(const block_element_t *b)
+{
+    return live_slots && live_slots[live_find(b)];
+}
+
+static void live_remove(const block_element_t *b)
+{
+    if (!live_slots)
+        return;
+
+    size_t mask = ((size_t) 1 << live_bits) - 1;
+    size_t hole = live_find(b);
+    if (!live_slots[hole])
+        return;
+
+    /* Shift later members of the probe sequence back into the hole, so
+     * lookups never need tombstones.
+     */
+    for (size_t i = (hole + 1) & mask; live_slots[i]; i = (i + 1) & mask) {
+        size_t home = live_hash(live_slots[i]);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            live_slots[hole] = live_slots[i];
+            hole = i;
+        }
+    }
+    live_slots[hole] = NULL;
+}
+
 /* Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
  */
@@ -81,13 +200,7 @@ static block_element_t *find_header(void *p)
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
     if (cautious_mode) {
         /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        if (!live_contains(b)) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
@@ -106,6 +219,80 @@ static block_element_t *find_header(void *p)
     return b;
 }
 
+/* Pick the smallest size class fitting size, N_SLAB_CLASS if none does */
+static size_t slab_class(size_t size)
+{
+    size_t cls = 0;
+    while (cls < N_SLAB_CLASS && slab_class_size[cls] < size)
+        cls++;
+    return cls;
+}
+
+static void slab_push(slab_chunk_t *c)
+{
+    c->prev = NULL;
+    c->next = slab_partial[c->cls];
+    if (c->next)
+        c->next->prev = c;
+    slab_partial[c->cls] = c;
+}
+
+static void slab_unlink(slab_chunk_t *c)
+{
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        slab_partial[c->cls] = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+}
+
+/* Take one slot of the given class, NULL if the system is out of memory */
+static block_element_t *slab_alloc(size_t cls)
+{
+    slab_chunk_t *c = slab_partial[cls];
+    if (!c) {
+        c = malloc(SLAB_CHUNK_SIZE);
+        if (!c)
+            return NULL;
+        c->free_slots = NULL;
+        c->used = c->carved = 0;
+        c->slot_size =
+            sizeof(block_element_t) + slab_class_size[cls] + sizeof(size_t);
+        c->slot_size = (c->slot_size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+        c->nslots = (SLAB_CHUNK_SIZE - sizeof(slab_chunk_t)) / c->slot_size;
+        c->cls = cls;
+        slab_push(c);
+    }
+
+    block_element_t *b = c->free_slots;
+    if (b)
+        c->free_slots = b->next;
+    else
+        b = (block_element_t *) &c->slots[c->carved++ * c->slot_size];
+    b->chunk = c;
+
+    /* A full chunk has nothing more to offer */
+    if (++c->used == c->nslots)
+        slab_unlink(c);
+    return b;
+}
+
+static void slab_free(block_element_t *b)
+{
+    slab_chunk_t *c = b->chunk;
+    if (c->used-- == c->nslots)
+        slab_push(c);
+    b->next = c->free_slots;
+    c->free_slots = b;
+
+    /* Keep the last chunk of a class around to avoid thrashing */
+    if (!c->used && (c->prev || c->next)) {
+        slab_unlink(c);
+        free(c);
+    }
+}
+
 /* Given pointer to block, find its footer */
 static size_t *find_footer(block_element_t *b)
 {
@@ -129,28 +316,35 @@ void *test_malloc(size_t size)
         return NULL;
     }
 
-    block_element_t *new_block =
-        malloc(size + sizeof(block_element_t) + sizeof(size_t));
+    /* Make room in the index first, so that failing leaks nothing */
+    if (!live_reserve(allocated_count + 1)) {
+        report_event(MSG_FATAL, "Couldn't grow the index of allocated blocks");
+        error_occurred = true;
+        return NULL;
+    }
+
+    block_element_t *new_block;
+    size_t cls = alloc_mode == ALLOC_ARENA ? slab_class(size) : N_SLAB_CLASS;
+    if (cls < N_SLAB_CLASS) {
+        new_block = slab_alloc(cls);
+    } else {
+        new_block = malloc(size + sizeof(block_element_t) + sizeof(size_t));
+        if (new_block)
+            new_block->chunk = NULL;
+    }
     if (!new_block) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
+        return NULL;
     }
 
-    // cppcheck-suppress nullPointerRedundantCheck
     new_block->magic_header = MAGICHEADER;
-    // cppcheck-suppress nullPointerRedundantCheck
     new_block->payload_size = size;
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
 
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
+    live_slots[live_find(new_block)] = new_block;
     allocated_count++;
 
     return p;
@@ -191,17 +385,12 @@ void test_free(void *p)
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_element_t *bn = b->next;
-    block_element_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
-    else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
+    live_remove(b);
 
-    free(b);
+    if (b->chunk)
+        slab_free(b);
+    else
+        free(b);
     allocated_count--;
 }
 
@@ -24,6 +24,15 @@ size_t allocation_check();
 /* Probability of malloc failing, expressed as percent */
 extern int fail_probability;
 
+/* Where test_malloc takes memory from */
+typedef enum {
+    ALLOC_SYSTEM, /* One system malloc per block */
+    ALLOC_ARENA,  /* Small blocks are carved from shared size-class slabs */
+} alloc_mode_t;
+
+/* Current allocation backend, one of alloc_mode_t */
+extern int alloc_mode;
+
 /*
  * Set/unset cautious mode.
  * In this mode, makes extra sure any block to be freed is currently allocated.
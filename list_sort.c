@@ -83,12 +83,62 @@ static struct list_head *merge(void *priv,
     return head;
 }
 
+/* Detach the maximal run starting at list and return its head, reversing a
+ * strictly descending run so that equal nodes keep their order. *rest
+ * receives the remainder of the list and *len the length of the run.
+ */
+static struct list_head *find_run(void *priv,
+                                  list_cmp_func_t cmp,
+                                  struct list_head *list,
+                                  struct list_head **rest,
+                                  size_t *len)
+{
+    struct list_head *head = list, *next = list->next;
+    size_t n = 1;
+
+    if (next && cmp(priv, list, next) > 0) {
+        list->next = NULL;
+        do {
+            struct list_head *tmp = next->next;
+            next->next = head;
+            head = next;
+            next = tmp;
+            n++;
+        } while (next && cmp(priv, head, next) > 0);
+    } else {
+        /* The first pair is already known to be in order */
+        while (next) {
+            list = next;
+            next = list->next;
+            n++;
+            if (next && cmp(priv, list, next) > 0)
+                break;
+        }
+        list->next = NULL;
+    }
+    *rest = next;
+    *len = n;
+    return head;
+}
+
+/* Merge the two newest pending runs */
+static struct list_head *merge_pending(void *priv,
+                                       list_cmp_func_t cmp,
+                                       struct list_head *pending)
+{
+    struct list_head *b = pending, *a = b->prev;
+    size_t size = list_run_size(a) + list_run_size(b);
+    struct list_head *list = merge(priv, cmp, a, b);
+    list->prev = a->prev;
+    list_run_set_size(list, size);
+    return list;
+}
+
 void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 {
     /* pending is a prev-linked "list of lists" of sorted sublists awaiting to
      * be merged */
     struct list_head *list = head->next, *pending = NULL;
-    size_t count = 0; /* Count of pending */
 
     /* zero or one element */
     if (list == head->prev)
@@ -97,34 +147,40 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
     /* Convert to null-terminated singly-linked list */
     head->prev->next = NULL;
 
+    /* The input is consumed a natural run at a time, so presorted input
+     * costs O(n) comparisons. Ranking runs by the highest set bit of their
+     * size, the pending runs behave like the digits of the binary counter
+     * in the original list_sort(): their ranks strictly decrease from the
+     * oldest to the newest, and a run is merged once one of at least its
+     * rank follows it. Merges are thus balanced as long as the natural runs
+     * are, and only adjacent runs are merged, which keeps the sort stable.
+     */
     do {
-        size_t bits;
-        struct list_head **tail = &pending;
-
-        /* find the least significant bit of count */
-        for (bits = count; bits & 1; bits >>= 1)
-            tail = &(*tail)->prev;
-        if (bits) {
-            /* perform merge */
-            struct list_head *a = *tail, *b = a->prev;
-            a = merge(priv, cmp, b, a);
-
-            /* install b's prev link to new merged sublist */
-            a->prev = b->prev;
-            *tail = a;
-        }
-        /* move one element from list to pending */
-        list->prev = pending;
-        pending = list;
-        list = list->next;
-        pending->next = NULL;
-        count++;
-
+        size_t len;
+        struct list_head *run = find_run(priv, cmp, list, &list, &len);
+
+        /* Combine the pending runs below the new one's rank first, rather
+         * than merging each of them into it in turn */
+        while (pending && pending->prev &&
+               !list_rank_le(len, list_run_size(pending->prev)))
+            pending = merge_pending(priv, cmp, pending);
+
+        run->prev = pending;
+        pending = run;
+        list_run_set_size(run, len);
+        while (pending->prev && list_rank_le(list_run_size(pending->prev),
+                                             list_run_size(pending)))
+            pending = merge_pending(priv, cmp, pending);
     } while (list);
 
     /* final merge */
     list = pending;
     pending = pending->prev;
+    if (!pending) {
+        /* The input was a single run */
+        list_build_prev_link(head, list);
+        return;
+    }
     for (;;) {
         struct list_head *next = pending->prev;
 
@@ -135,4 +191,4 @@ void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp)
     }
     /* The final merge, rebuilding prev links */
     merge_final(priv, cmp, head, pending, list);
-}
\ No newline at end of file
+}
@@ -22,5 +22,195 @@ typedef int (*list_cmp_func_t)(void *,
  */
 void list_sort(void *priv, struct list_head *head, list_cmp_func_t cmp);
 
+/* Helpers shared by list_sort() and DEFINE_LIST_SORT. The size of a pending
+ * run is kept in the prev pointer of its second node, as timsort.c does; a
+ * run of one node has no second node.
+ */
+static inline size_t list_run_size(const struct list_head *run)
+{
+    return run->next ? (size_t) run->next->prev : 1;
+}
+
+static inline void list_run_set_size(struct list_head *run, size_t size)
+{
+    if (run->next)
+        run->next->prev = (struct list_head *) size;
+}
+
+/* Whether the highest set bit of a is not above that of b */
+static inline bool list_rank_le(size_t a, size_t b)
+{
+    return !(b < a && b < (a ^ b));
+}
+
+/* Hang the sorted null-terminated list off head, rebuilding prev links */
+static inline void list_build_prev_link(struct list_head *head,
+                                        struct list_head *list)
+{
+    struct list_head *tail = head;
+    for (; list; tail = list, list = list->next) {
+        tail->next = list;
+        list->prev = tail;
+    }
+    tail->next = head;
+    head->prev = tail;
+}
+
+/**
+ * DEFINE_LIST_SORT - stamp out a list_sort specialized for one comparison
+ * @name: name of the generated function, void name(struct list_head *head)
+ * @type: type of the entries in the list
+ * @member: name of the list_head within @type
+ * @cmp_expr: expression comparing 'const type *a' and 'const type *b', with
+ *            the sign convention of list_cmp_func_t
+ *
+ * The generated sort is the same algorithm as list_sort(), but @cmp_expr is
+ * expanded inline instead of being called through a function pointer for
+ * every comparison. Use it at file scope; the functions are static.
+ */
+#define DEFINE_LIST_SORT(name, type, member, cmp_expr)                        \
+    static inline int name##_cmp(const struct list_head *la,                  \
+                                 const struct list_head *lb)                  \
+    {                                                                         \
+        const type *a = list_entry(la, type, member);                         \
+        const type *b = list_entry(lb, type, member);                         \
+        return (cmp_expr);                                                    \
+    }                                                                         \
+                                                                              \
+    static struct list_head *name##_merge(struct list_head *a,                \
+                                          struct list_head *b)                \
+    {                                                                         \
+        struct list_head *head = NULL, **tail = &head;                        \
+        for (;;) {                                                            \
+            /* if equal, take 'a' -- important for sort stability */          \
+            if (name##_cmp(a, b) <= 0) {                                      \
+                *tail = a;                                                    \
+                tail = &a->next;                                              \
+                a = a->next;                                                  \
+                if (!a) {                                                     \
+                    *tail = b;                                                \
+                    break;                                                    \
+                }                                                             \
+            } else {                                                          \
+                *tail = b;                                                    \
+                tail = &b->next;                                              \
+                b = b->next;                                                  \
+                if (!b) {                                                     \
+                    *tail = a;                                                \
+                    break;                                                    \
+                }                                                             \
+            }                                                                 \
+        }                                                                     \
+        return head;                                                          \
+    }                                                                         \
+                                                                              \
+    static void name##_merge_final(struct list_head *head,                    \
+                                   struct list_head *a, struct list_head *b)  \
+    {                                                                         \
+        struct list_head *tail = head;                                        \
+        for (;;) {                                                            \
+            if (name##_cmp(a, b) <= 0) {                                      \
+                tail->next = a;                                               \
+                a->prev = tail;                                               \
+                tail = a;                                                     \
+                a = a->next;                                                  \
+                if (!a)                                                       \
+                    break;                                                    \
+            } else {                                                          \
+                tail->next = b;                                               \
+                b->prev = tail;                                               \
+                tail = b;                                                     \
+                b = b->next;                                                  \
+                if (!b) {                                                     \
+                    b = a;                                                    \
+                    break;                                                    \
+                }                                                             \
+            }                                                                 \
+        }                                                                     \
+        tail->next = b;                                                       \
+        do {                                                                  \
+            b->prev = tail;                                                   \
+            tail = b;                                                         \
+            b = b->next;                                                      \
+        } while (b);                                                          \
+        tail->next = head;                                                    \
+        head->prev = tail;                                                    \
+    }                                                                         \
+                                                                              \
+    static struct list_head *name##_find_run(                                 \
+        struct list_head *list, struct list_head **rest, size_t *len)         \
+    {                                                                         \
+        struct list_head *head = list, *next = list->next;                    \
+        size_t n = 1;                                                         \
+        if (next && name##_cmp(list, next) > 0) {                             \
+            list->next = NULL;                                                \
+            do {                                                              \
+                struct list_head *tmp = next->next;                           \
+                next->next = head;                                            \
+                head = next;                                                  \
+                next = tmp;                                                   \
+                n++;                                                          \
+            } while (next && name##_cmp(head, next) > 0);                     \
+        } else {                                                              \
+            while (next) {                                                    \
+                list = next;                                                  \
+                next = list->next;                                            \
+                n++;                                                          \
+                if (next && name##_cmp(list, next) > 0)                       \
+                    break;                                                    \
+            }                                                                 \
+            list->next = NULL;                                                \
+        }                                                                     \
+        *rest = next;                                                         \
+        *len = n;                                                             \
+        return head;                                                          \
+    }                                                                         \
+                                                                              \
+    static struct list_head *name##_merge_pending(struct list_head *pending)  \
+    {                                                                         \
+        struct list_head *b = pending, *a = b->prev;                          \
+        size_t size = list_run_size(a) + list_run_size(b);                    \
+        struct list_head *list = name##_merge(a, b);                          \
+        list->prev = a->prev;                                                 \
+        list_run_set_size(list, size);                                        \
+        return list;                                                          \
+    }                                                                         \
+                                                                              \
+    static void name(struct list_head *head)                                  \
+    {                                                                         \
+        struct list_head *list = head->next, *pending = NULL;                 \
+        if (list == head->prev)                                               \
+            return;                                                           \
+        head->prev->next = NULL;                                              \
+        do {                                                                  \
+            size_t len;                                                       \
+            struct list_head *run = name##_find_run(list, &list, &len);       \
+            while (pending && pending->prev &&                                \
+                   !list_rank_le(len, list_run_size(pending->prev)))          \
+                pending = name##_merge_pending(pending);                      \
+            run->prev = pending;                                              \
+            pending = run;                                                    \
+            list_run_set_size(run, len);                                      \
+            while (pending->prev &&                                           \
+                   list_rank_le(list_run_size(pending->prev),                 \
+                                list_run_size(pending)))                      \
+                pending = name##_merge_pending(pending);                      \
+        } while (list);                                                       \
+        list = pending;                                                       \
+        pending = pending->prev;                                              \
+        if (!pending) {                                                       \
+            list_build_prev_link(head, list);                                 \
+            return;                                                           \
+        }                                                                     \
+        for (;;) {                                                            \
+            struct list_head *next = pending->prev;                           \
+            if (!next)                                                        \
+                break;                                                        \
+            list = name##_merge(pending, list);                               \
+            pending = next;                                                   \
+        }                                                                     \
+        name##_merge_final(head, pending, list);                              \
+    }
+
 
 #endif
\ No newline at end of file
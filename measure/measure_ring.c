@@ -0,0 +1,110 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ring.h"
+
+#define RING_CAPACITY 1024
+#define MAX_BATCH 256
+#define STR_LEN 16
+
+typedef struct {
+    ring_t *ring;
+    long ops;
+    int batch;
+    bool ok;
+} bench_t;
+
+static void *producer(void *p)
+{
+    bench_t *b = p;
+    char bufs[MAX_BATCH][STR_LEN];
+    char *strings[MAX_BATCH];
+
+    for (int i = 0; i < MAX_BATCH; i++)
+        strings[i] = bufs[i];
+
+    for (long seq = 0; seq < b->ops;) {
+        int n = b->ops - seq < b->batch ? b->ops - seq : b->batch;
+        for (int i = 0; i < n; i++)
+            snprintf(bufs[i], STR_LEN, "%ld", seq + i);
+
+        /* Retry the part of the batch which did not fit */
+        for (int done = 0; done < n;) {
+            int cnt = ring_insert_tail_n(b->ring, strings + done, n - done);
+            if (!cnt)
+                sched_yield();
+            done += cnt;
+        }
+        seq += n;
+    }
+    return NULL;
+}
+
+static void *consumer(void *p)
+{
+    bench_t *b = p;
+    char *out[MAX_BATCH];
+
+    for (long seq = 0; seq < b->ops;) {
+        int cnt = ring_remove_head_n(b->ring, out, b->batch);
+        if (!cnt)
+            sched_yield();
+        for (int i = 0; i < cnt; i++, seq++) {
+            if (atol(out[i]) != seq)
+                b->ok = false;
+            free(out[i]);
+        }
+    }
+    return NULL;
+}
+
+static double run(long ops, int batch, bool *ok)
+{
+    bench_t b = {.ring = ring_new(RING_CAPACITY), .ops = ops, .batch = batch};
+    struct timespec start, end;
+    pthread_t tids[2];
+
+    b.ok = b.ring != NULL;
+    if (!b.ok)
+        return 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&tids[0], NULL, producer, &b);
+    pthread_create(&tids[1], NULL, consumer, &b);
+    pthread_join(tids[0], NULL);
+    pthread_join(tids[1], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *ok = b.ok && ring_size(b.ring) == 0;
+    ring_free(b.ring);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+/* Usage: measure_ring [ops] [batch] */
+int main(int argc, char *argv[])
+{
+    long ops = argc > 1 ? atol(argv[1]) : 1000000;
+    int batch = argc > 2 ? atoi(argv[2]) : 64;
+    if (ops <= 0 || batch <= 0 || batch > MAX_BATCH) {
+        fprintf(stderr, "Usage: %s [ops] [batch <= %d]\n", argv[0],
+                MAX_BATCH);
+        return 1;
+    }
+
+    int batches[] = {1, batch};
+    for (int i = 0; i < 2; i++) {
+        bool ok = false;
+        double secs = run(ops, batches[i], &ok);
+        printf("==== Batch %d ====\n", batches[i]);
+        printf("  Elapsed:        %.6f s (%.2f Mops/s)\n", secs,
+               secs > 0 ? ops / secs / 1e6 : 0.0);
+        printf("  Order is %s\n", ok ? "preserved" : "broken");
+        if (!ok)
+            return 1;
+    }
+    return 0;
+}
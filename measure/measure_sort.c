@@ -13,6 +13,24 @@ enum Mode {
     Worst,
 };
 
+static const char *const mode_names[] = {
+    NULL,         "Random",        "Descend",   "Ascend", "Ascend3",
+    "AscendPlus", "AscendPercent", "Duplicate", "Equal",  "Worst",
+};
+
+/* Pack the first 8 bytes of s big-endian, so that comparing two keys orders
+ * them like strcmp() does for that prefix.
+ */
+static uint64_t key_prefix(const char *s)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = *s ? *s++ : 0;
+        key = key << 8 | c;
+    }
+    return key;
+}
+
 /* Distribution 1: random data */
 static void random_string(char *s, size_t charlen)
 {
@@ -47,9 +65,10 @@ static void worstcase_string(char *s, size_t charlen, int idx)
     monotonic_string(s, charlen, (idx < charlen / 2) ? charlen - 1 - idx : idx);
 }
 
-static void ascending_plus_string(char *s, size_t charlen, int idx)
+/* Ascending data followed by 10 random elements */
+static void ascending_plus_string(char *s, size_t charlen, int idx, int samples)
 {
-    if (idx < charlen - 10)
+    if (idx < samples - 10)
         monotonic_string(s, charlen, idx);
     else
         random_string(s, charlen);
@@ -107,7 +126,7 @@ static void create_sample(struct list_head *head,
             worstcase_string(elem->value, charlen, i);
             break;
         case AscendPlus:
-            ascending_plus_string(elem->value, charlen, i);
+            ascending_plus_string(elem->value, charlen, i, samples);
             break;
         /* default is ascending data */
         default:
@@ -128,18 +147,23 @@ static void create_sample(struct list_head *head,
 
     for (int i = 0; i < samples; i++) {
         element_t *elem = space + i;
+        elem->key = key_prefix(elem->value);
         list_add_tail(&elem->list, head);
     }
 }
 
-static void free_sample(element_t *space, int samples)
+static void clear_sample(element_t *space, int samples)
 {
     for (int i = 0; i < samples; i++) {
         element_t *elem = space + i;
         free(elem->value);
         list_del(&elem->list);
     }
+}
 
+static void free_sample(element_t *space, int samples)
+{
+    clear_sample(space, samples);
     free(space);
 }
 
@@ -157,6 +181,7 @@ static void copy_list(struct list_head *from,
         element_t *copy = space++;
         copy->value = malloc(sizeof(char) * (charlen + 1));
         copy->seq = entry->seq;
+        copy->key = entry->key;
         strncpy(copy->value, entry->value, charlen + 1);
         list_add_tail(&copy->list, to);
     }
@@ -170,20 +195,43 @@ static void copy_list(struct list_head *from,
 //     printf("\n");
 // }
 
+/* Only strings sharing a full 8-byte prefix need strcmp */
+static inline int element_cmp(const element_t *ea, const element_t *eb)
+{
+    if (ea->key != eb->key)
+        return ea->key < eb->key ? -1 : 1;
+    return (ea->key & 0xff) ? strcmp(ea->value + 8, eb->value + 8) : 0;
+}
+
 int compare(void *priv, const struct list_head *a, const struct list_head *b)
 {
     if (a == b)
         return 0;
 
-    // cppcheck-suppress nullPointer
-    int res = strcmp(list_entry(a, element_t, list)->value,
-                     // cppcheck-suppress nullPointer
-                     list_entry(b, element_t, list)->value);
-
     if (priv)
         *((int *) priv) += 1;
 
-    return res;
+    // cppcheck-suppress nullPointer
+    return element_cmp(list_entry(a, element_t, list),
+                       // cppcheck-suppress nullPointer
+                       list_entry(b, element_t, list));
+}
+
+/* Comparisons made by list_sort_inline() */
+static int inline_count;
+
+DEFINE_LIST_SORT(element_sort, element_t, list,
+                 (inline_count++, element_cmp(a, b)))
+
+static void list_sort_inline(void *priv,
+                             struct list_head *head,
+                             list_cmp_func_t cmp)
+{
+    (void) cmp;
+    inline_count = 0;
+    element_sort(head);
+    if (priv)
+        *((int *) priv) += inline_count;
 }
 
 bool check_list(struct list_head *head, int count)
@@ -216,7 +264,7 @@ bool check_list(struct list_head *head, int count)
         return false;
     }
 
-    if (ctr != SAMPLES) {
+    if (ctr != count) {
         fprintf(stderr, "\nERROR: Inconsistent number of elements: %ld\n", ctr);
         return false;
     }
@@ -224,31 +272,101 @@ bool check_list(struct list_head *head, int count)
 }
 
 
-int main(void)
+static const char *value_of(const struct list_head *node)
+{
+    // cppcheck-suppress nullPointer
+    return list_entry(node, element_t, list)->value;
+}
+
+static void radix_sort_asc(void *priv,
+                           struct list_head *head,
+                           list_cmp_func_t cmp)
+{
+    radix_sort(priv, head, cmp, value_of, false);
+}
+
+static uint64_t key_of(const struct list_head *node)
+{
+    // cppcheck-suppress nullPointer
+    return list_entry(node, element_t, list)->key;
+}
+
+static void array_sort_asc(void *priv,
+                           struct list_head *head,
+                           list_cmp_func_t cmp)
+{
+    struct list_head *node;
+    size_t n = 0;
+    list_for_each (node, head)
+        n++;
+
+    sort_slot_t *scratch = malloc(2 * n * sizeof(*scratch));
+    if (!scratch) {
+        list_sort(priv, head, cmp);
+        return;
+    }
+    array_sort(priv, head, cmp, key_of, false, scratch, n);
+    free(scratch);
+}
+
+static double elapsed(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+/* Usage: measure_sort [samples] [mode] [test]
+ * Only the tests whose name starts with the given one are run.
+ */
+int main(int argc, char *argv[])
 {
     struct list_head sample_head, warmdata_head, testdata_head;
     int count;
     int nums = SAMPLES;
+    size_t mode = Worst;
+    const char *only = NULL;
+
+    if (argc > 1)
+        nums = atoi(argv[1]);
+    if (argc > 2) {
+        mode = 0;
+        for (size_t i = Random; i <= Worst; i++) {
+            if (!strcmp(argv[2], mode_names[i]))
+                mode = i;
+        }
+    }
+    if (argc > 3)
+        only = argv[3];
+    if (nums <= 0 || !mode) {
+        fprintf(stderr, "Usage: %s [samples] [mode] [test]\n", argv[0]);
+        return 1;
+    }
 
     /* Assume ASLR */
     srand((uintptr_t) &main);
 
     test_t tests[] = {
         {.name = "timsort", .impl = timsort},
-        // {.name = "list_sort", .impl = list_sort},
+        {.name = "list_sort", .impl = list_sort},
+        {.name = "list_sort (inlined cmp)", .impl = list_sort_inline},
+        {.name = "radix_sort", .impl = radix_sort_asc},
+        {.name = "array_sort", .impl = array_sort_asc},
         {NULL, NULL},
     };
     test_t *test = tests;
 
     INIT_LIST_HEAD(&sample_head);
 
-    element_t *samples = malloc(sizeof(*samples) * SAMPLES);
-    element_t *warmdata = malloc(sizeof(*warmdata) * SAMPLES);
-    element_t *testdata = malloc(sizeof(*testdata) * SAMPLES);
+    element_t *samples = malloc(sizeof(*samples) * nums);
+    element_t *warmdata = malloc(sizeof(*warmdata) * nums);
+    element_t *testdata = malloc(sizeof(*testdata) * nums);
 
-    create_sample(&sample_head, samples, nums, CHAR_LEN, Worst);
+    create_sample(&sample_head, samples, nums, CHAR_LEN, mode);
+    printf("  %d samples, mode %s\n", nums, mode_names[mode]);
 
-    while (test->impl) {
+    for (; test->impl; test++) {
+        if (only && strncmp(test->name, only, strlen(only)))
+            continue;
         printf("==== Testing %s ====\n", test->name);
         /* Warm up */
         INIT_LIST_HEAD(&warmdata_head);
@@ -258,18 +376,25 @@ int main(void)
         test->impl(&count, &warmdata_head, compare);
 
         /* Test */
+        struct timespec start, end;
         count = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
         test->impl(&count, &testdata_head, compare);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double secs = elapsed(&start, &end);
         printf("  Comparisons:    %d\n", count);
+        printf("  Elapsed:        %.6f s (%.2f Melem/s)\n", secs,
+               secs > 0 ? nums / secs / 1e6 : 0.0);
         printf("  List is %s\n",
                check_list(&testdata_head, nums) ? "sorted" : "not sorted");
-        test++;
+        clear_sample(warmdata, nums);
+        clear_sample(testdata, nums);
     }
 
     printf("freeing sample\n");
     free_sample(samples, nums);
-    free_sample(warmdata, nums);
-    free_sample(testdata, nums);
+    free(warmdata);
+    free(testdata);
 
     return 0;
 }
\ No newline at end of file
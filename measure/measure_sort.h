@@ -8,8 +8,10 @@
 #include <string.h>
 #include <time.h>
 
+#include "array_sort.h"
 #include "list.h"
 #include "list_sort.h"
+#include "radix_sort.h"
 #include "timsort.h"
 
 #define SAMPLES 10
@@ -20,6 +22,7 @@ typedef struct {
     char *value;
     int seq;
     struct list_head list;
+    uint64_t key; /* Big-endian prefix of value, see key_prefix() */
 } element_t;
 
 typedef void (*test_func_t)(void *priv,
@@ -0,0 +1,131 @@
+#include <pthread.h>
+#include <signal.h>
+
+#include "parallel_sort.h"
+
+/* Lists with fewer nodes per thread are not worth splitting */
+#define PARALLEL_MIN_SEGMENT 1024
+
+typedef struct {
+    void *priv;
+    list_cmp_func_t cmp;
+    struct list_head *a, *b; /* b is merged into a, or NULL to sort a */
+} sort_task_t;
+
+/* Merge sorted list b into sorted list a, taking from a on ties */
+static void merge_lists(void *priv,
+                        list_cmp_func_t cmp,
+                        struct list_head *a,
+                        struct list_head *b)
+{
+    struct list_head *pos = a->next;
+
+    while (!list_empty(b)) {
+        struct list_head *node = b->next;
+        while (pos != a && cmp(priv, pos, node) <= 0)
+            pos = pos->next;
+        if (pos == a) {
+            list_splice_tail_init(b, a);
+            break;
+        }
+        /* Insert node in front of pos */
+        list_move_tail(node, pos);
+    }
+}
+
+static void *sort_worker(void *arg)
+{
+    sort_task_t *task = arg;
+
+    if (task->b)
+        merge_lists(task->priv, task->cmp, task->a, task->b);
+    else
+        list_sort(task->priv, task->a, task->cmp);
+    return NULL;
+}
+
+/* Run the tasks concurrently and wait for all of them. A task whose thread
+ * cannot be created runs on the calling thread instead.
+ *
+ * The qtest time limit longjmps out of the calling thread on SIGALRM, which
+ * would leave the workers relinking the list unjoined. SIGALRM is therefore
+ * held until every worker is joined; one that arrived meanwhile is delivered
+ * as soon as the old mask is restored.
+ */
+static void run_tasks(sort_task_t *tasks, int n)
+{
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    bool started[PARALLEL_MAX_THREADS];
+    sigset_t alrm, all, old, held;
+
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alrm, &old);
+
+    /* Threads inherit the signal mask of their creator */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &held);
+    for (int i = 0; i < n; i++)
+        started[i] = !pthread_create(&tids[i], NULL, sort_worker, &tasks[i]);
+    pthread_sigmask(SIG_SETMASK, &held, NULL);
+
+    for (int i = 0; i < n; i++) {
+        if (!started[i])
+            sort_worker(&tasks[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        if (started[i])
+            pthread_join(tids[i], NULL);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+void parallel_sort(void *priv,
+                   struct list_head *head,
+                   list_cmp_func_t cmp,
+                   int nthreads)
+{
+    struct list_head segs[PARALLEL_MAX_THREADS];
+    sort_task_t tasks[PARALLEL_MAX_THREADS];
+
+    if (nthreads > PARALLEL_MAX_THREADS)
+        nthreads = PARALLEL_MAX_THREADS;
+
+    size_t len = 0;
+    struct list_head *node;
+    list_for_each (node, head)
+        len++;
+
+    int nseg = nthreads;
+    if (len / PARALLEL_MIN_SEGMENT < (size_t) nseg)
+        nseg = len / PARALLEL_MIN_SEGMENT;
+    if (nseg < 2) {
+        list_sort(priv, head, cmp);
+        return;
+    }
+
+    /* Cut the list into nseg segments, the last one taking the remainder */
+    for (int i = 0; i < nseg - 1; i++) {
+        size_t seg_len = len / nseg;
+        node = head;
+        for (size_t j = 0; j < seg_len; j++)
+            node = node->next;
+        list_cut_position(&segs[i], head, node);
+    }
+    INIT_LIST_HEAD(&segs[nseg - 1]);
+    list_splice_init(head, &segs[nseg - 1]);
+
+    for (int i = 0; i < nseg; i++)
+        tasks[i] = (sort_task_t){priv, cmp, &segs[i], NULL};
+    run_tasks(tasks, nseg);
+
+    /* Merge tree: neighbours at distance width are merged pairwise */
+    for (int width = 1; width < nseg; width *= 2) {
+        int n = 0;
+        for (int i = 0; i + width < nseg; i += 2 * width)
+            tasks[n++] = (sort_task_t){priv, cmp, &segs[i], &segs[i + width]};
+        run_tasks(tasks, n);
+    }
+
+    list_splice(&segs[0], head);
+}
@@ -0,0 +1,30 @@
+#ifndef LAB0_PARALLELSORT_H
+#define LAB0_PARALLELSORT_H
+
+#include "list.h"
+#include "list_sort.h"
+
+/* Upper bound of worker threads used by parallel_sort() */
+#define PARALLEL_MAX_THREADS 64
+
+/**
+ * parallel_sort - multithreaded merge sort
+ * @priv: private data, opaque to parallel_sort(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: the elements comparison function, must be thread-safe
+ * @nthreads: number of threads to use, at most PARALLEL_MAX_THREADS
+ *
+ * The list is cut into @nthreads segments of about the same length with
+ * list_cut_position(). Each segment is sorted by list_sort() on its own
+ * thread, then pairs of sorted segments are merged concurrently, level by
+ * level, until one list is left. Short lists, or @nthreads below 2, are
+ * sorted by list_sort() directly. The sort is stable.
+ *
+ * Worker threads block all signals, so handlers run on the calling thread.
+ */
+void parallel_sort(void *priv,
+                   struct list_head *head,
+                   list_cmp_func_t cmp,
+                   int nthreads);
+
+#endif
@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
 #include <stdio.h>
@@ -44,12 +46,13 @@ extern int show_entropy;
  */
 #include "queue.h"
 
-#define SELECT_SORT 1
-#if (SELECT_SORT == 1)
+#include "array_sort.h"
+#include "cqueue.h"
+#include "ext_sort.h"
 #include "list_sort.h"
-#elif (SELECT_SORT == 2)
+#include "parallel_sort.h"
+#include "radix_sort.h"
 #include "timsort.h"
-#endif
 #include "console.h"
 #include "report.h"
 
@@ -59,7 +62,6 @@ extern int show_entropy;
 
 /* How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST_SIZE 30
 
@@ -81,8 +83,41 @@ static int string_length = MAXSTRING;
 
 static int descend = 0;
 
+/* Number of threads used by list_sort, see parallel_sort() */
+static int sort_threads = 1;
+
+/* Sorting algorithm used by the sort command */
+typedef enum {
+    SORT_AUTO,
+    SORT_LIST,
+    SORT_TIM,
+    SORT_Q,
+    SORT_RADIX,
+    SORT_ARRAY,
+    SORT_TOPK, /* Selected by "sort k", not by name */
+} sort_mode_t;
+
+static const char *const sort_names[] = {
+    "auto", "list_sort", "timsort", "q_sort", "radix", "array", NULL,
+};
+
+static int sort_mode = SORT_AUTO;
+
+/* How many adjacent pairs, spread across the queue, the auto sort mode
+ * inspects */
+#define SORT_AUTO_SAMPLE 1024
+
+/* Memory budget of extsort when option mblimit is unset */
+#define EXTSORT_BUDGET (8 << 20)
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
+
+/* How many strings queue_insert hands to the bulk insertion API at once */
+#define INSERT_BATCH 256
+
+/* How many removed strings queue_remove_n keeps a copy of */
+#define REMOVE_BUF_STRINGS 64
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
 /* For queue_insert and queue_remove */
 typedef enum {
@@ -90,13 +125,16 @@ typedef enum {
     POS_HEAD,
 } position_t;
 
+/* Comparator for list_sort and timsort. A non-NULL priv points to a flag
+ * selecting descending order.
+ */
 __attribute__((nonnull(2, 3))) int cmp(void *priv,
                                        const struct list_head *list1,
                                        const struct list_head *list2)
 {
-    element_t *list1_entry = list_entry(list1, element_t, list);
-    element_t *list2_entry = list_entry(list2, element_t, list);
-    return strcmp(list1_entry->value, list2_entry->value) < 0 ? 0 : 1;
+    int res = q_element_cmp(list_entry(list1, element_t, list),
+                            list_entry(list2, element_t, list));
+    return priv && *(int *) priv ? -res : res;
 }
 
 
@@ -118,9 +156,6 @@ static bool do_free(int argc, char *argv[])
     }
     error_check();
 
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     struct list_head *qnext = NULL;
     if (chain.size > 1) {
         qnext = (current->chain.next == &chain.head) ? chain.head.next
@@ -133,7 +168,6 @@ static bool do_free(int argc, char *argv[])
         if (exception_setup(true))
             q_free(current->q);
         exception_cancel();
-        set_cautious_mode(true);
     }
 
     if (current) {
@@ -214,8 +248,8 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
         return ok;
     }
 
-    char *lasts = NULL;
-    char randstr_buf[MAX_RANDSTR_LEN];
+    char *batch[INSERT_BATCH];
+    char randstr_buf[INSERT_BATCH][MAX_RANDSTR_LEN];
     int reps = 1;
     bool ok = true, need_rand = false;
     if (argc != 2 && argc != 3) {
@@ -231,10 +265,8 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
         }
     }
 
-    if (!strcmp(inserts, "RAND")) {
+    if (!strcmp(inserts, "RAND"))
         need_rand = true;
-        inserts = randstr_buf;
-    }
 
     if (!current || !current->q)
         report(3, "Warning: Calling insert %s on null queue",
@@ -242,44 +274,72 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     error_check();
 
     if (current && exception_setup(true)) {
-        for (int r = 0; ok && r < reps; r++) {
-            if (need_rand)
-                fill_rand_string(randstr_buf, sizeof(randstr_buf));
-            bool rval = pos == POS_TAIL ? q_insert_tail(current->q, inserts)
-                                        : q_insert_head(current->q, inserts);
-            if (rval) {
-                current->size++;
-                element_t *entry =
-                    pos == POS_TAIL
-                        ? list_last_entry(current->q, element_t, list)
-                        : list_first_entry(current->q, element_t, list);
-                char *cur_inserts = entry->value;
+        /* Repeated insertions go through the bulk API one batch at a time */
+        for (int r = 0; ok && r < reps; r += INSERT_BATCH) {
+            int n = reps - r < INSERT_BATCH ? reps - r : INSERT_BATCH;
+            for (int i = 0; i < n; i++) {
+                batch[i] = inserts;
+                if (need_rand) {
+                    fill_rand_string(randstr_buf[i], sizeof(randstr_buf[i]));
+                    batch[i] = randstr_buf[i];
+                }
+            }
+
+            int cnt;
+            if (reps == 1) {
+                bool rval = pos == POS_TAIL
+                                ? q_insert_tail(current->q, batch[0])
+                                : q_insert_head(current->q, batch[0]);
+                cnt = rval ? 1 : 0;
+            } else {
+                cnt = pos == POS_TAIL
+                          ? q_insert_tail_bulk(current->q, batch, n)
+                          : q_insert_head_bulk(current->q, batch, n);
+            }
+            current->size += cnt;
+
+            if (cnt) {
+                /* Inspect the newest element and its neighbor */
+                struct list_head *end =
+                    pos == POS_TAIL ? current->q->prev : current->q->next;
+                struct list_head *neighbor =
+                    pos == POS_TAIL ? end->prev : end->next;
+                char *cur_inserts = list_entry(end, element_t, list)->value;
+                bool copied = true;
+                for (int i = 0; r == 0 && i < n; i++)
+                    copied = copied && batch[i] != cur_inserts;
+
                 if (!cur_inserts) {
                     report(1, "ERROR: Failed to save copy of string in queue");
                     ok = false;
-                } else if (r == 0 && inserts == cur_inserts) {
+                } else if (!copied) {
                     report(1,
                            "ERROR: Need to allocate and copy string for new "
                            "queue element");
                     ok = false;
                     break;
-                } else if (r == 1 && lasts == cur_inserts) {
+                } else if (r == 0 && cnt > 1 &&
+                           list_entry(neighbor, element_t, list)->value ==
+                               cur_inserts) {
                     report(1,
                            "ERROR: Need to allocate separate string for each "
                            "queue element");
                     ok = false;
                     break;
                 }
-                lasts = cur_inserts;
-            } else {
+            }
+
+            for (int i = cnt; i < n; i++) {
                 fail_count++;
                 if (fail_count < fail_limit)
-                    report(2, "Insertion of %s failed", inserts);
+                    report(2, "Insertion of %s failed",
+                           n == 1 ? batch[0] : inserts);
                 else {
                     report(1,
                            "ERROR: Insertion of %s failed (%d failures total)",
-                           inserts, fail_count);
+                           n == 1 ? batch[0] : inserts, fail_count);
                     ok = false;
+                    break;
                 }
             }
             ok = ok && !error_check();
@@ -303,6 +363,92 @@ static bool do_it(int argc, char *argv[])
     return queue_insert(POS_TAIL, argc, argv);
 }
 
+/* Remove n elements at once through the batched drain API */
+static bool queue_remove_n(position_t pos, int n)
+{
+    int expect = current ? current->size : 0;
+    if (expect > n)
+        expect = n;
+    /* Room for the strings of at most REMOVE_BUF_STRINGS elements */
+    int nstr = expect < REMOVE_BUF_STRINGS ? expect : REMOVE_BUF_STRINGS;
+    size_t bufsize = (size_t) nstr * (string_length + 1) + 1;
+
+    char *removes = malloc(bufsize + STRINGPAD);
+    size_t *offsets = malloc(sizeof(size_t) * (expect + 1));
+    if (!removes || !offsets) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for removed strings");
+        free(removes);
+        free(offsets);
+        return false;
+    }
+    memset(removes, 'X', bufsize + STRINGPAD);
+
+    if (!current || !current->size)
+        report(3, "Warning: Calling remove %s on empty queue",
+               pos == POS_TAIL ? "tail" : "head");
+    error_check();
+
+    LIST_HEAD(out);
+    int cnt = 0;
+    if (current && exception_setup(true))
+        cnt = pos == POS_TAIL ? q_remove_tail_n(current->q, &out, n, removes,
+                                                bufsize, offsets)
+                              : q_remove_head_n(current->q, &out, n, removes,
+                                                bufsize, offsets);
+    exception_cancel();
+
+    bool ok = true;
+    if (cnt != expect) {
+        report(1, "ERROR: Removed %d elements, but expected %d", cnt, expect);
+        ok = false;
+    }
+
+    int i = 0;
+    element_t *item, *tmp;
+    list_for_each_entry (item, &out, list) {
+        if (i >= cnt)
+            break;
+        /* Strings which fit in the buffer must have been copied intact */
+        size_t len = strlen(item->value);
+        if (ok && offsets[i] + len < bufsize - 1 &&
+            strcmp(removes + offsets[i], item->value)) {
+            report(1, "ERROR: Removed value %s != copied value %s",
+                   item->value, removes + offsets[i]);
+            ok = false;
+        }
+        i++;
+    }
+    if (i != cnt) {
+        report(1, "ERROR: %d elements removed, but %d returned", cnt, i);
+        ok = false;
+    }
+
+    /* Everything past the buffer must be untouched */
+    size_t j = bufsize;
+    while (j < bufsize + STRINGPAD && removes[j] == 'X')
+        j++;
+    if (j != bufsize + STRINGPAD) {
+        report(1,
+               "ERROR: copying of strings in batched remove overflowed "
+               "destination buffer.");
+        ok = false;
+    }
+
+    list_for_each_entry_safe (item, tmp, &out, list)
+        q_release_element(item);
+    if (current)
+        current->size -= cnt;
+    if (ok)
+        report(2, "Removed %d elements from queue", cnt);
+
+    q_show(3);
+
+    free(removes);
+    free(offsets);
+    return ok && !error_check();
+}
+
 static bool queue_remove(position_t pos, int argc, char *argv[])
 {
     /* FIXME: It is known that both functions is_remove_tail_const() and
@@ -432,10 +578,129 @@ static inline bool do_rt(int argc, char *argv[])
     return queue_remove(POS_TAIL, argc, argv);
 }
 
+static bool queue_remove_count(position_t pos, int argc, char *argv[])
+{
+    int n;
+    if (argc != 2 || !get_int(argv[1], &n) || n <= 0) {
+        report(1, "%s needs a positive number of elements", argv[0]);
+        return false;
+    }
+    return queue_remove_n(pos, n);
+}
+
+static inline bool do_rhn(int argc, char *argv[])
+{
+    return queue_remove_count(POS_HEAD, argc, argv);
+}
+
+static inline bool do_rtn(int argc, char *argv[])
+{
+    return queue_remove_count(POS_TAIL, argc, argv);
+}
+
+/* Check current->q against l_copy, its sorted content before 'dedup' */
+static bool check_dedup(struct list_head *l_copy)
+{
+    bool ok = true;
+    element_t *item;
+    struct list_head *l_tmp = current->q->next;
+    bool is_this_dup = false;
+    // Compare between new list and old one
+    list_for_each_entry (item, l_copy, list) {
+        // Skip comparison with new list if the string is duplicate
+        bool is_next_dup =
+            item->list.next != l_copy &&
+            strcmp(list_entry(item->list.next, element_t, list)->value,
+                   item->value) == 0;
+        if (is_this_dup || is_next_dup) {
+            // Update list size
+            current->size--;
+        } else if (l_tmp != current->q &&
+                   strcmp(list_entry(l_tmp, element_t, list)->value,
+                          item->value) == 0)
+            l_tmp = l_tmp->next;
+        else
+            ok = false;
+        is_this_dup = is_next_dup;
+    }
+    // All elements in new list should be traversed
+    return ok && l_tmp == current->q;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Number of strings in the sorted array equal to s */
+static size_t count_sorted(char **sorted, size_t n, const char *s)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(sorted[mid], s) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    size_t first = lo;
+    hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strcmp(sorted[mid], s) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo - first;
+}
+
+/* Check current->q against l_copy, its content before 'dedup all' */
+static bool check_dedup_all(struct list_head *l_copy)
+{
+    size_t n = 0;
+    struct list_head *l_tmp;
+    list_for_each (l_tmp, l_copy)
+        n++;
+
+    char **sorted = malloc(n * sizeof(char *) + 1);
+    if (!sorted) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for duplicate "
+               "checking");
+        return false;
+    }
+
+    element_t *item;
+    size_t i = 0;
+    list_for_each_entry (item, l_copy, list)
+        sorted[i++] = item->value;
+    qsort(sorted, n, sizeof(char *), cmp_str);
+
+    bool ok = true;
+    l_tmp = current->q->next;
+    list_for_each_entry (item, l_copy, list) {
+        if (count_sorted(sorted, n, item->value) > 1) {
+            current->size--;
+        } else if (l_tmp != current->q &&
+                   strcmp(list_entry(l_tmp, element_t, list)->value,
+                          item->value) == 0)
+            l_tmp = l_tmp->next;
+        else
+            ok = false;
+    }
+    free(sorted);
+
+    return ok && l_tmp == current->q;
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
+    bool all = false;
+    if (argc == 2 && !strcmp(argv[1], "all")) {
+        all = true;
+    } else if (argc != 1) {
+        report(1, "%s takes no arguments or 'all'", argv[0]);
         return false;
     }
 
@@ -479,7 +744,7 @@ static bool do_dedup(int argc, char *argv[])
 
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_dup(current->q);
+        ok = all ? q_delete_dup_all(current->q) : q_delete_dup(current->q);
     exception_cancel();
 
     if (!ok) {
@@ -487,32 +752,14 @@ static bool do_dedup(int argc, char *argv[])
             free(item->value);
             free(item);
         }
-        report(1, "ERROR: Calling delete duplicate on null queue");
+        if (all)
+            report(1, "ERROR: Could not allocate space to delete duplicates");
+        else
+            report(1, "ERROR: Calling delete duplicate on null queue");
         return false;
     }
 
-    struct list_head *l_tmp = current->q->next;
-    bool is_this_dup = false;
-    // Compare between new list and old one
-    list_for_each_entry (item, &l_copy, list) {
-        // Skip comparison with new list if the string is duplicate
-        bool is_next_dup =
-            item->list.next != &l_copy &&
-            strcmp(list_entry(item->list.next, element_t, list)->value,
-                   item->value) == 0;
-        if (is_this_dup || is_next_dup) {
-            // Update list size
-            current->size--;
-        } else if (l_tmp != current->q &&
-                   strcmp(list_entry(l_tmp, element_t, list)->value,
-                          item->value) == 0)
-            l_tmp = l_tmp->next;
-        else
-            ok = false;
-        is_this_dup = is_next_dup;
-    }
-    // All elements in new list should be traversed
-    ok = ok && l_tmp == current->q;
+    ok = all ? check_dedup_all(&l_copy) : check_dedup(&l_copy);
     if (!ok)
         report(1,
                "ERROR: Duplicate strings are in queue or distinct strings are "
@@ -596,41 +843,70 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
-bool do_sort(int argc, char *argv[])
+/* list_sort with q_element_cmp() inlined, one instance per direction */
+DEFINE_LIST_SORT(element_sort_asc, element_t, list, q_element_cmp(a, b))
+DEFINE_LIST_SORT(element_sort_desc, element_t, list, q_element_cmp(b, a))
+
+static const char *elem_str(const struct list_head *node)
 {
-    if (argc != 1) {
-        report(1, "%s takes no arguments", argv[0]);
-        return false;
-    }
+    // cppcheck-suppress nullPointer
+    return list_entry(node, element_t, list)->value;
+}
 
-    int cnt = 0;
-    if (!current || !current->q)
-        report(3, "Warning: Calling sort on null queue");
-    else
-        cnt = q_size(current->q);
-    error_check();
+static uint64_t elem_key(const struct list_head *node)
+{
+    // cppcheck-suppress nullPointer
+    return list_entry(node, element_t, list)->key;
+}
 
-    if (cnt < 2)
-        report(3, "Warning: Calling sort on single node");
-    error_check();
+/* Pick a sorter from the presortedness of the queue of cnt elements, judged
+ * by adjacent pairs sampled at a regular stride across all of it. Data made
+ * of few runs, ascending or descending, or of long stretches of equal values
+ * goes to timsort, whose run detection and galloping exploit it. Anything
+ * else goes to list_sort.
+ */
+static sort_mode_t sort_auto(struct list_head *head, int cnt)
+{
+    int pairs = 0, inversions = 0, equal = 0;
+    int stride = cnt / SORT_AUTO_SAMPLE > 1 ? cnt / SORT_AUTO_SAMPLE : 1;
+    struct list_head *node = head->next;
+
+    for (; node != head && node->next != head && pairs < SORT_AUTO_SAMPLE;
+         pairs++) {
+        int res = cmp(&descend, node, node->next);
+        if (res > 0)
+            inversions++;
+        else if (!res)
+            equal++;
+        for (int i = 0; i < stride && node != head; i++)
+            node = node->next;
+    }
+
+    if (!pairs)
+        return SORT_LIST;
+    if (inversions * 8 <= pairs || inversions * 8 >= pairs * 7 ||
+        equal * 2 >= pairs)
+        return SORT_TIM;
+    return SORT_LIST;
+}
 
-    set_noallocate_mode(true);
-    if (current && exception_setup(true)) {
-#if SELECT_SORT == 1
-        list_sort(NULL, current->q, cmp);
-#elif SELECT_SORT == 2
-        timsort(NULL, current->q, cmp);
-#else
-        q_sort(current->q, descend);
-#endif
+/* Check the order of the cnt elements of the current queue. With topk set,
+ * only the first topk of them need to be in order, ahead of all the others.
+ */
+static bool check_sorted(int cnt, int topk)
+{
+    /* Only the first topk elements need to be in order */
+    int rest = 0;
+    if (topk && topk < cnt) {
+        rest = cnt - topk;
+        cnt = topk;
     }
-    exception_cancel();
-    set_noallocate_mode(false);
 
     bool ok = true;
+    struct list_head *cur_l = NULL;
     if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --cnt; cur_l = cur_l->next) {
+        for (cur_l = current->q->next; cur_l != current->q && --cnt;
+             cur_l = cur_l->next) {
             /* Ensure each element in ascending/descending order */
             element_t *item, *next_item;
             item = list_entry(cur_l, element_t, list);
@@ -649,6 +925,154 @@ bool do_sort(int argc, char *argv[])
         }
     }
 
+    /* cur_l is now the last of the first topk elements */
+    if (ok && rest) {
+        const char *last = list_entry(cur_l, element_t, list)->value;
+        for (struct list_head *node = cur_l->next; node != current->q;
+             node = node->next) {
+            int res = strcmp(list_entry(node, element_t, list)->value, last);
+            if (descend ? res > 0 : res < 0) {
+                report(1, "ERROR: Not the %d %s elements", topk,
+                       descend ? "largest" : "smallest");
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    return ok;
+}
+
+bool do_sort(int argc, char *argv[])
+{
+    int mode = sort_mode, topk = 0;
+    if (argc == 2 && get_int(argv[1], &topk)) {
+        if (topk <= 0) {
+            report(1, "Invalid number of elements to sort: %s", argv[1]);
+            return false;
+        }
+    } else if (argc == 2) {
+        for (mode = 0; sort_names[mode]; mode++) {
+            if (!strcmp(argv[1], sort_names[mode]))
+                break;
+        }
+    }
+    if (argc > 2 || !sort_names[mode]) {
+        report(1, "%s takes no arguments, a sorting algorithm or a count",
+               argv[0]);
+        return false;
+    }
+
+    int cnt = 0;
+    if (!current || !current->q)
+        report(3, "Warning: Calling sort on null queue");
+    else
+        cnt = q_size(current->q);
+    error_check();
+
+    if (cnt < 2)
+        report(3, "Warning: Calling sort on single node");
+    error_check();
+
+    if (current && topk)
+        mode = SORT_TOPK;
+    else if (current && mode == SORT_AUTO)
+        mode = sort_auto(current->q, cnt);
+
+    /* The array sort needs its scratch space before allocation is barred */
+    sort_slot_t *scratch = NULL;
+    if (mode == SORT_ARRAY && cnt > 1) {
+        scratch = malloc(2 * cnt * sizeof(sort_slot_t));
+        if (!scratch) {
+            report(1, "INTERNAL ERROR.  Could not allocate space for sorting");
+            return false;
+        }
+    }
+
+    set_noallocate_mode(true);
+    if (current && exception_setup(true)) {
+        switch (mode) {
+        case SORT_TIM:
+            timsort_n(&descend, current->q, cmp, current->size);
+            break;
+        case SORT_Q:
+            q_sort(current->q, descend);
+            break;
+        case SORT_RADIX:
+            radix_sort(&descend, current->q, cmp, elem_str, descend);
+            break;
+        case SORT_ARRAY:
+            array_sort(&descend, current->q, cmp, elem_key, descend, scratch,
+                       cnt);
+            break;
+        case SORT_TOPK:
+            q_sort_topk(current->q, topk, descend);
+            break;
+        default:
+            if (sort_threads > 1)
+                parallel_sort(&descend, current->q, cmp, sort_threads);
+            else if (descend)
+                element_sort_desc(current->q);
+            else
+                element_sort_asc(current->q);
+            break;
+        }
+    }
+    exception_cancel();
+    set_noallocate_mode(false);
+    free(scratch);
+
+    bool ok = check_sorted(cnt, topk);
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_extsort(int argc, char *argv[])
+{
+    if (argc > 2) {
+        report(1, "%s takes no arguments or an output file", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling extsort on null queue");
+        return false;
+    }
+    error_check();
+
+    FILE *out = NULL;
+    if (argc == 2 && !(out = fopen(argv[1], "w"))) {
+        report(1, "ERROR: Could not open '%s' for writing", argv[1]);
+        return false;
+    }
+
+    /* Sort in chunks of half the memory left under mblimit, leaving the rest
+     * to the merge */
+    size_t budget = mem_available();
+    budget = budget == SIZE_MAX ? EXTSORT_BUDGET : budget / 2;
+
+    int cnt = current->size;
+    bool ok = false;
+    if (exception_setup(true))
+        ok = ext_sort(current->q, descend, budget, out);
+    exception_cancel();
+    if (out && fclose(out))
+        ok = false;
+
+    if (!ok) {
+        report(1, "ERROR: External sort failed");
+        /* Elements may have been lost or moved */
+        struct list_head *node;
+        current->size = 0;
+        list_for_each (node, current->q)
+            current->size++;
+    } else if (out) {
+        current->size = 0;
+    } else {
+        ok = check_sorted(cnt, 0);
+    }
+
     q_show(3);
     return ok && !error_check();
 }
@@ -848,7 +1272,7 @@ static bool do_merge(int argc, char *argv[])
     exception_cancel();
     set_noallocate_mode(false);
 
-    if (q_size(&chain.head) > 1) {
+    if (chain.size > 1) {
         chain.size = 1;
         current = list_entry(chain.head.next, queue_contex_t, chain);
         current->size = len;
@@ -977,6 +1401,188 @@ static bool q_show(int vlevel)
     return ok;
 }
 
+/* Per-thread state of the 'stress' command */
+typedef struct {
+    cqueue_t *q;
+    int tid;
+    int ops;            /* Elements to insert, producers only */
+    atomic_long *total; /* Elements all producers insert */
+    atomic_long *consumed;
+    long done;          /* Successful operations of this thread */
+    double lat_sum;     /* Latency of successful operations, in ns */
+    double lat_max;
+    bool ok;
+} stress_arg_t;
+
+static double stress_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void stress_record(stress_arg_t *arg, double start)
+{
+    double lat = stress_now() - start;
+    arg->done++;
+    arg->lat_sum += lat;
+    if (lat > arg->lat_max)
+        arg->lat_max = lat;
+}
+
+static void *stress_producer(void *p)
+{
+    stress_arg_t *arg = p;
+    char buf[32];
+
+    for (int i = 0; i < arg->ops; i++) {
+        snprintf(buf, sizeof(buf), "%d-%d", arg->tid, i);
+        double start = stress_now();
+        if (!cq_insert_tail(arg->q, arg->tid, buf)) {
+            /* Do not let the consumers wait for the rest */
+            atomic_fetch_sub(arg->total, arg->ops - i);
+            arg->ok = false;
+            break;
+        }
+        stress_record(arg, start);
+    }
+    return NULL;
+}
+
+/* Remove until all produced elements are consumed. Elements of the same
+ * producer must arrive in the order they were inserted.
+ */
+static void *stress_consumer(void *p)
+{
+    stress_arg_t *arg = p;
+    int last[CQ_MAX_THREADS];
+
+    for (int i = 0; i < CQ_MAX_THREADS; i++)
+        last[i] = -1;
+
+    while (atomic_load(arg->consumed) < atomic_load(arg->total)) {
+        double start = stress_now();
+        element_t *e = cq_remove_head(arg->q, arg->tid, NULL, 0);
+        if (!e) {
+            sched_yield();
+            continue;
+        }
+        stress_record(arg, start);
+        atomic_fetch_add(arg->consumed, 1);
+
+        int producer, seq;
+        if (sscanf(e->value, "%d-%d", &producer, &seq) != 2 || producer < 0 ||
+            producer >= CQ_MAX_THREADS || seq <= last[producer])
+            arg->ok = false;
+        else
+            last[producer] = seq;
+        cq_release_element(e);
+    }
+    return NULL;
+}
+
+static void stress_report(const char *what,
+                          const stress_arg_t *args,
+                          int from,
+                          int to)
+{
+    long done = 0;
+    double sum = 0, max = 0;
+    for (int i = from; i < to; i++) {
+        done += args[i].done;
+        sum += args[i].lat_sum;
+        if (args[i].lat_max > max)
+            max = args[i].lat_max;
+    }
+    report(1, "  %s: %ld ops, latency avg %.0f ns, max %.0f ns", what, done,
+           done ? sum / done : 0.0, max);
+}
+
+static bool do_stress(int argc, char *argv[])
+{
+    if (argc > 3) {
+        report(1, "%s takes 0-2 arguments", argv[0]);
+        return false;
+    }
+
+    int threads = 4, ops = 100000;
+    if (argc > 1 && (!get_int(argv[1], &threads) || threads < 2 ||
+                     threads > CQ_MAX_THREADS)) {
+        report(1, "Number of threads must be between 2 and %d",
+               CQ_MAX_THREADS);
+        return false;
+    }
+    if (argc > 2 && (!get_int(argv[2], &ops) || ops < 1)) {
+        report(1, "Invalid number of operations '%s'", argv[2]);
+        return false;
+    }
+
+    cqueue_t *q = cq_new();
+    if (!q) {
+        report(1, "INTERNAL ERROR.  Could not allocate concurrent queue");
+        return false;
+    }
+
+    /* Producers take the lower slots, consumers the rest */
+    int producers = threads / 2;
+    atomic_long expected, consumed;
+    atomic_init(&expected, (long) producers * ops);
+    atomic_init(&consumed, 0);
+    stress_arg_t args[CQ_MAX_THREADS];
+    pthread_t tids[CQ_MAX_THREADS];
+    for (int i = 0; i < threads; i++) {
+        args[i] = (stress_arg_t){
+            .q = q,
+            .tid = i,
+            .ops = ops,
+            .total = &expected,
+            .consumed = &consumed,
+            .ok = true,
+        };
+    }
+
+    /* Workers block all signals, leaving SIGALRM to this thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    double start = stress_now();
+    int started = 0;
+    for (; started < threads; started++) {
+        void *(*fn)(void *) =
+            started < producers ? stress_producer : stress_consumer;
+        if (pthread_create(&tids[started], NULL, fn, &args[started]))
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    bool ok = started == threads;
+    if (!ok) {
+        /* Let the consumers which did start finish */
+        report(1, "ERROR: Could not create thread %d", started);
+        atomic_store(&expected, 0);
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+    double secs = (stress_now() - start) * 1e-9;
+
+    for (int i = 0; i < started; i++)
+        ok = ok && args[i].ok;
+    ok = ok && cq_size(q) == 0;
+    cq_free(q);
+    if (!ok) {
+        report(1, "ERROR: Concurrent queue lost or reordered elements");
+        return false;
+    }
+
+    long total = 2 * (long) producers * ops;
+    report(1, "%d producers, %d consumers: %ld ops in %.3f s, %.0f ops/s",
+           producers, threads - producers, total, secs,
+           secs > 0 ? total / secs : 0.0);
+    stress_report("insert", args, 0, producers);
+    stress_report("remove", args, producers, threads);
+    return true;
+}
+
 static bool do_show(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1036,6 +1642,18 @@ static bool do_next(int argc, char *argv[])
     return q_show(0);
 }
 
+/* Names of the allocation backends, indexed by alloc_mode_t */
+static const char *const alloc_names[] = {"system", "arena", NULL};
+
+static void set_threads(int oldval)
+{
+    if (sort_threads < 1 || sort_threads > PARALLEL_MAX_THREADS) {
+        report(1, "Number of threads must be between 1 and %d",
+               PARALLEL_MAX_THREADS);
+        sort_threads = oldval;
+    }
+}
+
 static void console_init()
 {
     ADD_COMMAND(new, "Create new queue", "");
@@ -1043,28 +1661,44 @@ static void console_init()
     ADD_COMMAND(prev, "Switch to previous queue", "");
     ADD_COMMAND(next, "Switch to next queue", "");
     ADD_COMMAND(ih,
-                "Insert string str at head of queue n times. Generate random "
-                "string(s) if str equals RAND. (default: n == 1)",
+                "Insert string str at head of queue n times, in batches for "
+                "n > 1. Generate random string(s) if str equals RAND. "
+                "(default: n == 1)",
                 "str [n]");
     ADD_COMMAND(it,
-                "Insert string str at tail of queue n times. Generate random "
-                "string(s) if str equals RAND. (default: n == 1)",
+                "Insert string str at tail of queue n times, in batches for "
+                "n > 1. Generate random string(s) if str equals RAND. "
+                "(default: n == 1)",
                 "str [n]");
-    ADD_COMMAND(
-        rh,
-        "Remove from head of queue. Optionally compare to expected value str",
-        "[str]");
-    ADD_COMMAND(
-        rt,
-        "Remove from tail of queue. Optionally compare to expected value str",
-        "[str]");
+    ADD_COMMAND(rh,
+                "Remove from head of queue. Optionally compare to expected "
+                "value str",
+                "[str]");
+    ADD_COMMAND(rhn, "Remove n elements from head of queue at once", "n");
+    ADD_COMMAND(rt,
+                "Remove from tail of queue. Optionally compare to expected "
+                "value str",
+                "[str]");
+    ADD_COMMAND(rtn, "Remove n elements from tail of queue at once", "n");
     ADD_COMMAND(reverse, "Reverse queue", "");
-    ADD_COMMAND(sort, "Sort queue in ascending/descening order", "");
+    ADD_COMMAND(sort,
+                "Sort queue in ascending/descening order, optionally with "
+                "the given algorithm instead of option sort, or order only "
+                "the first k elements",
+                "[algorithm | k]");
+    ADD_COMMAND(extsort,
+                "Sort queue through run files on disk within option mblimit, "
+                "optionally writing it to file instead",
+                "[file]");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
     ADD_COMMAND(show, "Show queue contents", "");
     ADD_COMMAND(dm, "Delete middle node in queue", "");
-    ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "");
+    ADD_COMMAND(dedup, "Delete all nodes that have duplicate string", "[all]");
     ADD_COMMAND(merge, "Merge all the queues into one sorted queue", "");
+    ADD_COMMAND(stress,
+                "Run producer and consumer threads on a lock-free concurrent "
+                "queue, half of them each (default: 4 threads, 100000 ops)",
+                "[threads] [ops]");
     ADD_COMMAND(swap, "Swap every two adjacent nodes in queue", "");
     ADD_COMMAND(ascend,
                 "Remove every node which has a node with a strictly less "
@@ -1080,10 +1714,19 @@ static void console_init()
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
               NULL);
+    add_param_choices("alloc", &alloc_mode,
+                      "Allocation backend for queue memory (system/arena)",
+                      NULL, alloc_names);
     add_param("fail", &fail_limit,
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("threads", &sort_threads, "Number of threads used by list_sort",
+              set_threads);
+    add_param_choices("sort", &sort_mode,
+                      "Sorting algorithm "
+                      "(auto/list_sort/timsort/q_sort/radix/array)",
+                      NULL, sort_names);
 }
 
 /* Signal handlers */
@@ -1116,8 +1759,6 @@ static void q_init()
 static bool q_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
 
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
@@ -1131,7 +1772,6 @@ static bool q_quit(int argc, char *argv[])
     }
 
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
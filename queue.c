@@ -11,14 +11,71 @@
  *   cppcheck-suppress nullPointer
  */
 
+/**
+ * queue_head_t - Header of a queue
+ * @head: list head handed out by q_new()
+ * @size: number of elements, kept up to date by every queue operation
+ * @blocks: blocks the elements are carved from (unrolled backend only)
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+#ifdef QUEUE_UNROLLED
+    struct list_head blocks;
+#endif
+} queue_head_t;
+
+static inline queue_head_t *q_head(struct list_head *head)
+{
+    return container_of(head, queue_head_t, head);
+}
+
+#ifdef QUEUE_UNROLLED
+
+/* Unrolled backend: every queue owns a list of fixed-size blocks, and each
+ * block holds QBLOCK_SLOTS consecutive slots. A slot is an element together
+ * with room for a short string, so elements inserted one after another sit
+ * next to each other in memory and walking the queue becomes a mostly
+ * sequential scan. Slots are carved in order and never reused; a block goes
+ * back to the system once it is full and all its elements were released,
+ * or when its queue is freed and it holds no removed element any more.
+ */
+#define QBLOCK_SLOTS 64
+
+/* Strings shorter than this are stored inline in the slot */
+#define QSLOT_STR 32
+
+typedef struct {
+    struct list_head link; /* Empty once the owning queue is freed */
+    int used;              /* Slots carved so far */
+    int live;              /* Carved slots not released yet */
+    unsigned char slots[];
+} qblock_t;
+
+typedef struct {
+    qblock_t *block;
+    element_t elem; /* Followed by the inline string */
+} qslot_t;
+
+#define QSLOT_SIZE ((sizeof(qslot_t) + QSLOT_STR + 7) & ~(size_t) 7)
+
+static void qblock_release(qblock_t *b)
+{
+    if (!list_empty(&b->link))
+        list_del(&b->link);
+    free(b);
+}
+
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    struct list_head *head = malloc(sizeof(struct list_head));
-    if (!head)
+    queue_head_t *q = malloc(sizeof(queue_head_t));
+    if (!q)
         return NULL;
-    INIT_LIST_HEAD(head);
-    return head;
+    INIT_LIST_HEAD(&q->head);
+    INIT_LIST_HEAD(&q->blocks);
+    q->size = 0;
+    return &q->head;
 }
 
 /* Free all storage used by queue */
@@ -27,31 +84,136 @@ void q_free(struct list_head *head)
     if (!head)
         return;
     element_t *entry, *safe;
-    list_for_each_entry_safe (entry, safe, head, list) {
-        if (entry->value)
-            free(entry->value);
-        free(entry);
+    list_for_each_entry_safe (entry, safe, head, list)
+        q_release_element(entry);
+
+    /* Blocks still holding removed elements outlive the queue */
+    qblock_t *b, *tmp;
+    list_for_each_entry_safe (b, tmp, &q_head(head)->blocks, link) {
+        if (b->live)
+            list_del_init(&b->link);
+        else
+            qblock_release(b);
     }
-    free(head);
+    free(q_head(head));
 }
 
+/* Carve an element for s out of the last block of the queue */
+static element_t *element_new(struct list_head *head, const char *s)
+{
+    queue_head_t *q = q_head(head);
+    size_t len = strlen(s);
+    char *value = NULL;
+    if (len >= QSLOT_STR) {
+        value = malloc(len + 1);
+        if (!value)
+            return NULL;
+        memcpy(value, s, len + 1);
+    }
+
+    qblock_t *b = list_empty(&q->blocks)
+                      ? NULL
+                      : list_last_entry(&q->blocks, qblock_t, link);
+    if (!b || b->used == QBLOCK_SLOTS) {
+        b = malloc(sizeof(qblock_t) + QBLOCK_SLOTS * QSLOT_SIZE);
+        if (!b) {
+            free(value);
+            return NULL;
+        }
+        b->used = b->live = 0;
+        list_add_tail(&b->link, &q->blocks);
+    }
+
+    qslot_t *slot = (qslot_t *) &b->slots[b->used++ * QSLOT_SIZE];
+    b->live++;
+    slot->block = b;
+    element_t *new = &slot->elem;
+    if (!value) {
+        memcpy(new->data, s, len + 1);
+        value = new->data;
+    }
+    new->value = value;
+    new->key = q_key_prefix(value);
+    return new;
+}
+
+/* Release an element carved out of a block */
+void q_release_element(element_t *e)
+{
+    qblock_t *b = container_of(e, qslot_t, elem)->block;
+    if (e->value != e->data)
+        free(e->value);
+    if (!--b->live && (b->used == QBLOCK_SLOTS || list_empty(&b->link)))
+        qblock_release(b);
+}
+
+#else /* !QUEUE_UNROLLED */
+
+/* Create an empty queue */
+struct list_head *q_new()
+{
+    queue_head_t *q = malloc(sizeof(queue_head_t));
+    if (!q)
+        return NULL;
+    INIT_LIST_HEAD(&q->head);
+    q->size = 0;
+    return &q->head;
+}
+
+/* Free all storage used by queue */
+void q_free(struct list_head *head)
+{
+    if (!head)
+        return;
+    element_t *entry, *safe;
+    list_for_each_entry_safe (entry, safe, head, list)
+        q_release_element(entry);
+    free(q_head(head));
+}
+
+/* Strings shorter than this take the fast path: they are measured with a
+ * bounded scan and every such node is allocated with the same size.
+ */
+#define ELEMENT_SHORT_STR 16
+
+/* Allocate an element with its string stored inline behind the node */
+static element_t *element_new(struct list_head *head, const char *s)
+{
+    size_t len = strnlen(s, ELEMENT_SHORT_STR);
+    if (len == ELEMENT_SHORT_STR)
+        len += strlen(s + len);
+    size_t cap = len < ELEMENT_SHORT_STR ? ELEMENT_SHORT_STR : len + 1;
+
+    element_t *new = malloc(sizeof(element_t) + cap);
+    if (!new)
+        return NULL;
+    memcpy(new->data, s, len + 1);
+    new->value = new->data;
+    new->key = q_key_prefix(new->data);
+    return new;
+}
+
+/* Release an element and its string */
+void q_release_element(element_t *e)
+{
+    if (e->value != e->data)
+        free(e->value);
+    free(e);
+}
+
+#endif /* QUEUE_UNROLLED */
+
 /* Insert an element at head of queue */
 bool q_insert_head(struct list_head *head, char *s)
 {
-    if (!head)
+    if (!head || !s)
         return false;
 
-    element_t *new = (element_t *) malloc(sizeof(element_t));
+    element_t *new = element_new(head, s);
     if (!new)
         return false;
-    int str_size = sizeof(char) * (strlen(s) + 1);
-    new->value = (char *) malloc(str_size);
-    if (!new->value) {
-        free(new);
-        return false;
-    }
-    strncpy(new->value, s, str_size);
     list_add(&new->list, head);
+    q_head(head)->size++;
     return true;
 }
 
@@ -61,21 +223,69 @@ bool q_insert_tail(struct list_head *head, char *s)
     if (!head || !s)
         return false;
 
-    element_t *new = malloc(sizeof(element_t));
+    element_t *new = element_new(head, s);
     if (!new)
         return false;
+    list_add_tail(&new->list, head);
+    q_head(head)->size++;
+    return true;
+}
 
-    int str_size = sizeof(char) * (strlen(s) + 1);
-    new->value = malloc(str_size);
-    if (!new->value) {
-        free(new->value);
-        free(new);
-        return false;
+/* Allocate elements of queue head for strings into batch, adding each one at
+ * the head of batch if at_head is set and at the tail otherwise.
+ * Return the number of elements allocated.
+ *
+ * The batch is not allocated as one block: q_release_element() must be able
+ * to free every element on its own, and the harness checks each block
+ * separately. Without QUEUE_UNROLLED this is still one allocation per
+ * element, its string stored inline; the unrolled backend already carves
+ * QBLOCK_SLOTS elements out of each block. What the bulk path saves is the
+ * per-call overhead and the splicing.
+ */
+static int element_new_batch(struct list_head *head,
+                             struct list_head *batch,
+                             char **strings,
+                             int n,
+                             bool at_head)
+{
+    int cnt = 0;
+    for (int i = 0; i < n; i++) {
+        element_t *new = strings[i] ? element_new(head, strings[i]) : NULL;
+        if (!new)
+            continue;
+        if (at_head)
+            list_add(&new->list, batch);
+        else
+            list_add_tail(&new->list, batch);
+        cnt++;
     }
+    return cnt;
+}
 
-    strncpy(new->value, s, str_size);
-    list_add_tail(&new->list, head);
-    return true;
+/* Insert several elements at head of queue */
+int q_insert_head_bulk(struct list_head *head, char **strings, int n)
+{
+    if (!head || !strings)
+        return 0;
+
+    LIST_HEAD(batch);
+    int cnt = element_new_batch(head, &batch, strings, n, true);
+    list_splice(&batch, head);
+    q_head(head)->size += cnt;
+    return cnt;
+}
+
+/* Insert several elements at tail of queue */
+int q_insert_tail_bulk(struct list_head *head, char **strings, int n)
+{
+    if (!head || !strings)
+        return 0;
+
+    LIST_HEAD(batch);
+    int cnt = element_new_batch(head, &batch, strings, n, false);
+    list_splice_tail(&batch, head);
+    q_head(head)->size += cnt;
+    return cnt;
 }
 
 /* Remove an element from head of queue */
@@ -91,6 +301,7 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
         sp[bufsize - 1] = '\0';
     }
     list_del(&remove->list);
+    q_head(head)->size--;
     return remove;
 }
 
@@ -107,22 +318,96 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
         sp[bufsize - 1] = '\0';
     }
     list_del(&remove->list);
+    q_head(head)->size--;
     return remove;
 }
 
-/* Return number of elements in queue */
-int q_size(struct list_head *head)
+/* Copy the strings of list into buf back to back, recording their offsets */
+static void copy_values(struct list_head *list,
+                        char *buf,
+                        size_t bufsize,
+                        size_t *offsets)
 {
-    if (!head || list_empty(head))
-        return 0;
+    if (!buf || !bufsize)
+        return;
 
-    int count = 0;
+    size_t pos = 0;
+    int i = 0;
     element_t *entry;
+    list_for_each_entry (entry, list, list) {
+        size_t len = strnlen(entry->value, bufsize - 1 - pos);
+        memcpy(buf + pos, entry->value, len);
+        buf[pos + len] = '\0';
+        if (offsets)
+            offsets[i++] = pos;
+        /* Stay on the last terminator once buf is full */
+        pos += len + 1;
+        if (pos > bufsize - 1)
+            pos = bufsize - 1;
+    }
+}
 
-    list_for_each_entry (entry, head, list)
-        count++;
+/* Remove up to n elements from head of queue */
+int q_remove_head_n(struct list_head *head,
+                    struct list_head *out,
+                    int n,
+                    char *buf,
+                    size_t bufsize,
+                    size_t *offsets)
+{
+    if (!head || !out || n <= 0 || list_empty(head))
+        return 0;
 
-    return count;
+    if (n > q_head(head)->size)
+        n = q_head(head)->size;
+    struct list_head *last = head;
+    for (int i = 0; i < n; i++)
+        last = last->next;
+
+    LIST_HEAD(removed);
+    list_cut_position(&removed, head, last);
+    q_head(head)->size -= n;
+    copy_values(&removed, buf, bufsize, offsets);
+    list_splice_tail(&removed, out);
+    return n;
+}
+
+/* Remove up to n elements from tail of queue */
+int q_remove_tail_n(struct list_head *head,
+                    struct list_head *out,
+                    int n,
+                    char *buf,
+                    size_t bufsize,
+                    size_t *offsets)
+{
+    if (!head || !out || n <= 0 || list_empty(head))
+        return 0;
+
+    if (n > q_head(head)->size)
+        n = q_head(head)->size;
+    struct list_head *first = head;
+    for (int i = 0; i < n; i++)
+        first = first->prev;
+
+    /* Cut off what stays, take the rest and put the former back */
+    LIST_HEAD(front);
+    LIST_HEAD(removed);
+    list_cut_position(&front, head, first->prev);
+    list_splice_init(head, &removed);
+    list_splice(&front, head);
+    q_head(head)->size -= n;
+    copy_values(&removed, buf, bufsize, offsets);
+    list_splice_tail(&removed, out);
+    return n;
+}
+
+/* Return number of elements in queue */
+int q_size(struct list_head *head)
+{
+    if (!head)
+        return 0;
+
+    return q_head(head)->size;
 }
 
 /* Delete the middle node in queue */
@@ -138,8 +423,8 @@ bool q_delete_mid(struct list_head *head)
         indir = &(*indir)->next;
     struct list_head *del = *indir;
     list_del(del);
-    free(list_entry(del, element_t, list)->value);
-    free(list_entry(del, element_t, list));
+    q_release_element(list_entry(del, element_t, list));
+    q_head(head)->size--;
     return true;
 }
 
@@ -153,10 +438,11 @@ bool q_delete_dup(struct list_head *head)
     element_t *node, *safe;
 
     list_for_each_entry_safe (node, safe, head, list) {
-        bool same = (&safe->list != head && !strcmp(node->value, safe->value));
+        bool same = (&safe->list != head && !q_element_cmp(node, safe));
         if (same || flag) {
             list_del(&node->list);
             q_release_element(node);
+            q_head(head)->size--;
         }
         flag = same;
     }
@@ -164,6 +450,75 @@ bool q_delete_dup(struct list_head *head)
     return true;
 }
 
+/* Slot of the hash table used by q_delete_dup_all() */
+typedef struct {
+    element_t *elem; /* First node seen with this value */
+    uint32_t hash;
+    bool dup; /* elem has been moved to the graveyard */
+} dedup_slot_t;
+
+/* FNV-1a */
+static uint32_t dedup_hash(const char *s)
+{
+    uint32_t h = 2166136261u;
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Delete all nodes that have duplicate string in an unsorted queue */
+bool q_delete_dup_all(struct list_head *head)
+{
+    if (!head)
+        return false;
+    if (list_empty(head) || list_is_singular(head))
+        return true;
+
+    /* Keep the load factor at or below 1/2 */
+    size_t cap = 8;
+    while (cap < (size_t) q_head(head)->size * 2)
+        cap <<= 1;
+    dedup_slot_t *table = malloc(cap * sizeof(dedup_slot_t));
+    if (!table)
+        return false;
+    memset(table, 0, cap * sizeof(dedup_slot_t));
+
+    /* The first node of a duplicated value is parked here until the end, as
+     * its slot still refers to it.
+     */
+    LIST_HEAD(graveyard);
+    element_t *node, *safe;
+    list_for_each_entry_safe (node, safe, head, list) {
+        uint32_t hash = dedup_hash(node->value);
+        size_t i = hash & (cap - 1);
+        while (table[i].elem && (table[i].hash != hash ||
+                                 q_element_cmp(table[i].elem, node)))
+            i = (i + 1) & (cap - 1);
+
+        dedup_slot_t *slot = &table[i];
+        if (!slot->elem) {
+            slot->elem = node;
+            slot->hash = hash;
+            continue;
+        }
+        if (!slot->dup) {
+            list_move_tail(&slot->elem->list, &graveyard);
+            slot->dup = true;
+            q_head(head)->size--;
+        }
+        list_del(&node->list);
+        q_release_element(node);
+        q_head(head)->size--;
+    }
+
+    list_for_each_entry_safe (node, safe, &graveyard, list)
+        q_release_element(node);
+    free(table);
+    return true;
+}
+
 /* Swap every two adjacent nodes */
 void q_swap(struct list_head *head)
 {
@@ -221,59 +576,242 @@ void q_reverseK(struct list_head *head, int k)
     }
 }
 
-struct list_head *mergeTwoLists(struct list_head *L1,
-                                struct list_head *L2,
-                                bool descend)
+/* Compare two elements in the requested order, by their cached keys first */
+static inline int elem_cmp(const struct list_head *a,
+                           const struct list_head *b,
+                           bool descend)
 {
-    struct list_head *head = NULL, **ptr = &head, **node;
+    int res = q_element_cmp(list_entry(a, element_t, list),
+                            list_entry(b, element_t, list));
+    return descend ? -res : res;
+}
 
-    for (node = NULL; L1 && L2; *node = (*node)->next) {
-        element_t *L1_entry = list_entry(L1, element_t, list);
-        element_t *L2_entry = list_entry(L2, element_t, list);
-        if (descend)
-            node = (strcmp(L1_entry->value, L2_entry->value) > 0) ? &L1 : &L2;
-        else
-            node = (strcmp(L1_entry->value, L2_entry->value) < 0) ? &L1 : &L2;
+/* Merge two null-terminated sorted lists, taking from a on ties */
+static struct list_head *merge_runs(struct list_head *a,
+                                    struct list_head *b,
+                                    bool descend)
+{
+    struct list_head *head = NULL, **tail = &head;
+
+    for (;;) {
+        if (elem_cmp(a, b, descend) <= 0) {
+            *tail = a;
+            tail = &a->next;
+            a = a->next;
+            if (!a) {
+                *tail = b;
+                break;
+            }
+        } else {
+            *tail = b;
+            tail = &b->next;
+            b = b->next;
+            if (!b) {
+                *tail = a;
+                break;
+            }
+        }
+    }
+    return head;
+}
 
-        *ptr = *node;
-        ptr = &(*ptr)->next;
+/* Detach the natural run starting at list and return its head. A strictly
+ * decreasing run is reversed on the fly, which keeps the sort stable.
+ * *rest receives the remainder of the list.
+ */
+static struct list_head *find_run(struct list_head *list,
+                                  struct list_head **rest,
+                                  bool descend)
+{
+    struct list_head *head = list, *next = list->next;
+
+    if (next && elem_cmp(list, next, descend) > 0) {
+        list->next = NULL;
+        do {
+            struct list_head *tmp = next->next;
+            next->next = head;
+            head = next;
+            next = tmp;
+        } while (next && elem_cmp(head, next, descend) > 0);
+    } else {
+        while (next && elem_cmp(list, next, descend) <= 0) {
+            list = next;
+            next = list->next;
+        }
+        list->next = NULL;
     }
-    *ptr = (struct list_head *) ((uintptr_t) L1 | (uintptr_t) L2);
+    *rest = next;
     return head;
 }
 
-struct list_head *mergesort_list(struct list_head *head, bool descend)
+/* Push a sorted run onto the stack of pending runs, linked through their prev
+ * pointers. As in list_sort.c, the binary representation of the number of
+ * pending runs decides when two runs of the same rank get merged.
+ */
+static void push_run(struct list_head **pending,
+                     size_t *count,
+                     struct list_head *run,
+                     bool descend)
 {
-    if (!head || !head->next)
-        return head;
-    struct list_head *slow = head;
-    for (struct list_head *fast = head->next; fast && fast->next;
-         fast = fast->next->next)
-        slow = slow->next;
-    struct list_head *mid = slow->next;
-    slow->next = NULL;
+    size_t bits;
+    struct list_head **tail = pending;
+
+    /* Find the least significant clear bit of count */
+    for (bits = *count; bits & 1; bits >>= 1)
+        tail = &(*tail)->prev;
+    if (bits) {
+        struct list_head *a = *tail, *b = a->prev;
+        a = merge_runs(b, a, descend);
+        a->prev = b->prev;
+        *tail = a;
+    }
 
-    struct list_head *left = mergesort_list(head, descend),
-                     *right = mergesort_list(mid, descend);
-    return mergeTwoLists(left, right, descend);
+    run->prev = *pending;
+    *pending = run;
+    (*count)++;
 }
 
-/* Sort elements of queue in ascending/descending order */
+/* Merge all pending runs, newest into older, and hang the result off head */
+static void finish_runs(struct list_head *head,
+                        struct list_head *pending,
+                        bool descend)
+{
+    struct list_head *list = pending;
+    pending = pending->prev;
+    while (pending) {
+        struct list_head *next = pending->prev;
+        list = merge_runs(pending, list, descend);
+        pending = next;
+    }
+
+    /* Rebuild prev links and close the circle */
+    struct list_head *prev = head;
+    head->next = list;
+    for (; list; prev = list, list = list->next)
+        list->prev = prev;
+    prev->next = head;
+    head->prev = prev;
+}
+
+/* Sort elements of queue in ascending/descending order
+ *
+ * Iterative bottom-up merge sort. The input is cut into natural runs which
+ * are pushed onto the stack of pending runs, so no recursion and no walk to
+ * find the middle of a list are needed.
+ */
 void q_sort(struct list_head *head, bool descend)
 {
-    // mergeSortList(head, descend);
     if (!head || list_empty(head) || list_is_singular(head))
         return;
+
+    struct list_head *list = head->next, *pending = NULL;
+    size_t count = 0; /* Number of pending runs */
+
+    /* Convert to null-terminated singly-linked list */
     head->prev->next = NULL;
-    head->next = mergesort_list(head->next, descend);
 
-    struct list_head **indir = &head;
-    while ((*indir)->next) {
-        (*indir)->next->prev = *indir;
-        indir = &(*indir)->next;
+    do {
+        struct list_head *run = find_run(list, &list, descend);
+        push_run(&pending, &count, run, descend);
+    } while (list);
+
+    finish_runs(head, pending, descend);
+}
+
+/* Return whichever of a, b and c holds the median value */
+static struct list_head *median_of_three(struct list_head *a,
+                                         struct list_head *b,
+                                         struct list_head *c,
+                                         bool descend)
+{
+    if (elem_cmp(a, b, descend) > 0) {
+        struct list_head *tmp = a;
+        a = b;
+        b = tmp;
     }
-    (*indir)->next = head;
-    head->prev = *indir;
+    if (elem_cmp(b, c, descend) <= 0)
+        return b;
+    return elem_cmp(a, c, descend) > 0 ? a : c;
+}
+
+/* Move the k smallest (largest if descend) elements to the front of queue in
+ * sorted order
+ *
+ * Quickselect over the list: each round partitions the candidates into
+ * those less than, equal to and greater than a median-of-three pivot, which
+ * keeps their relative order, and carries on with the part holding the k-th
+ * element. The parts known to lie after it are pushed to the front of the
+ * remainder, so that it ends up coarsely ordered. Selection takes O(n)
+ * expected comparisons, and sorting the prefix O(k log k) more. Equal
+ * elements keep their relative order, so the prefix matches that of a full
+ * stable sort.
+ */
+void q_sort_topk(struct list_head *head, int k, bool descend)
+{
+    if (!head || list_empty(head) || k <= 0)
+        return;
+
+    LIST_HEAD(work); /* Candidates for the remaining need places */
+    LIST_HEAD(top);  /* Elements known to be in the prefix */
+    LIST_HEAD(rest); /* Elements known to be out of it */
+    int n = q_size(head), need = k;
+
+    list_splice_init(head, &work);
+    while (need < n) {
+        struct list_head *mid = work.next;
+        for (int i = 0; i < n / 2; i++)
+            mid = mid->next;
+        struct list_head *pivot =
+            median_of_three(work.next, mid, work.prev, descend);
+
+        LIST_HEAD(less);
+        LIST_HEAD(equal);
+        int nl = 0, ne = 0;
+        struct list_head *node, *safe;
+        list_for_each_safe (node, safe, &work) {
+            int res = elem_cmp(node, pivot, descend);
+            if (res < 0) {
+                list_move_tail(node, &less);
+                nl++;
+            } else if (!res) {
+                list_move_tail(node, &equal);
+                ne++;
+            }
+        }
+        /* work now holds the greater part */
+
+        if (need <= nl) {
+            list_splice_init(&work, &rest);
+            list_splice(&equal, &rest);
+            list_splice(&less, &work);
+            n = nl;
+            continue;
+        }
+
+        list_splice_tail(&less, &top);
+        need -= nl;
+        if (need <= ne) {
+            /* Take the earliest of the equal elements */
+            struct list_head *last = equal.next;
+            for (int i = 1; i < need; i++)
+                last = last->next;
+            LIST_HEAD(taken);
+            list_cut_position(&taken, &equal, last);
+            list_splice_tail(&taken, &top);
+            list_splice_init(&work, &rest);
+            list_splice(&equal, &rest);
+            break;
+        }
+        list_splice_tail(&equal, &top);
+        need -= ne;
+        n -= nl + ne;
+    }
+
+    /* All remaining candidates belong to the prefix */
+    list_splice_tail(&work, &top);
+    list_splice(&top, head);
+    q_sort(head, descend);
+    list_splice_tail(&rest, head);
 }
 
 /* Remove every node which has a node with a strictly less value anywhere to
@@ -287,8 +825,8 @@ int q_ascend(struct list_head *head)
     int count = 1;
     while (cur != head) {
         count++;
-        int comp = strcmp(list_entry(cur, element_t, list)->value,
-                          list_entry(tmp, element_t, list)->value);
+        int comp = q_element_cmp(list_entry(cur, element_t, list),
+                                 list_entry(tmp, element_t, list));
         if (comp >= 0) {
             struct list_head *del = cur;
             cur = cur->prev;
@@ -300,6 +838,7 @@ int q_ascend(struct list_head *head)
             cur = cur->prev;
         }
     }
+    q_head(head)->size = count;
     return count;
 }
 
@@ -314,8 +853,8 @@ int q_descend(struct list_head *head)
     int count = 1;
     while (cur != head) {
         count++;
-        int comp = strcmp(list_entry(cur, element_t, list)->value,
-                          list_entry(tmp, element_t, list)->value);
+        int comp = q_element_cmp(list_entry(cur, element_t, list),
+                                 list_entry(tmp, element_t, list));
         if (comp <= 0) {
             struct list_head *del = cur;
             cur = cur->prev;
@@ -327,23 +866,53 @@ int q_descend(struct list_head *head)
             cur = cur->prev;
         }
     }
+    q_head(head)->size = count;
     return count;
 }
 
 /* Merge all the queues into one sorted queue, which is in ascending/descending
- * order */
+ * order
+ *
+ * Every queue is already sorted, so each one is pushed as a single run onto
+ * the pending stack used by q_sort(). Runs of equal rank are merged
+ * pairwise, which takes O(N log k) comparisons for k queues and keeps
+ * elements of earlier queues ahead of equal elements of later ones.
+ */
 int q_merge(struct list_head *head, bool descend)
 {
     if (!head || list_empty(head))
         return 0;
 
-    queue_contex_t *queue = container_of(head->next, queue_contex_t, chain);
-    queue_contex_t *node, *safe;
-    list_for_each_entry_safe (node, safe, head, chain) {
-        if (&node->chain != head->next)
-            list_splice_init(node->q, queue->q);
+    queue_contex_t *first = list_first_entry(head, queue_contex_t, chain);
+    struct list_head *pending = NULL;
+    size_t count = 0;
+    int size = 0;
+
+    queue_contex_t *ctx;
+    list_for_each_entry (ctx, head, chain) {
+        struct list_head *q = ctx->q;
+        if (!q || list_empty(q))
+            continue;
+
+        size += q_head(q)->size;
+        q_head(q)->size = 0;
+#ifdef QUEUE_UNROLLED
+        if (ctx != first)
+            list_splice_tail_init(&q_head(q)->blocks,
+                                  &q_head(first->q)->blocks);
+#endif
+
+        /* Detach the queue as a null-terminated run */
+        struct list_head *run = q->next;
+        q->prev->next = NULL;
+        INIT_LIST_HEAD(q);
+        push_run(&pending, &count, run, descend);
     }
-    q_sort(queue->q, descend);
 
-    return q_size(queue->q);
-}
\ No newline at end of file
+    if (pending) {
+        finish_runs(first->q, pending, descend);
+        q_head(first->q)->size = size;
+    }
+
+    return size;
+}
@@ -9,6 +9,8 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "harness.h"
 #include "list.h"
@@ -17,14 +19,62 @@
  * element_t - Linked list element
  * @value: pointer to array holding string
  * @list: node of a doubly-linked list
- *
- * @value needs to be explicitly allocated and freed
+ * @key: first 8 bytes of @value packed big-endian, see q_key_prefix()
+ * @data: inline storage for the string, allocated together with the node
+ *
+ * Elements created by q_insert_head() and q_insert_tail() keep the string in
+ * @data whenever the queue backend has room for it, so @value points right
+ * behind the node and one allocation covers both. An element whose @value
+ * was allocated separately is still released correctly by
+ * q_release_element().
  */
 typedef struct {
     char *value;
     struct list_head list;
+    uint64_t key;
+    char data[];
 } element_t;
 
+/**
+ * q_key_prefix() - Pack the first 8 bytes of a string into an integer
+ * @s: the string
+ *
+ * Bytes past the end of a shorter string count as zero. Comparing two keys
+ * as integers orders them the same way strcmp() orders the strings, as far
+ * as the first 8 bytes go.
+ *
+ * Return: the big-endian prefix of @s
+ */
+static inline uint64_t q_key_prefix(const char *s)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++) {
+        unsigned char c = *s ? *s++ : 0;
+        key = key << 8 | c;
+    }
+    return key;
+}
+
+/**
+ * q_element_cmp() - Compare the strings of two elements
+ * @a: first element
+ * @b: second element
+ *
+ * Only the cached keys are read unless they are equal. Equal keys of strings
+ * shorter than 8 bytes mean equal strings; otherwise strcmp() resumes after
+ * the common prefix.
+ *
+ * Return: less than, equal to, or greater than zero like strcmp()
+ */
+static inline int q_element_cmp(const element_t *a, const element_t *b)
+{
+    if (a->key != b->key)
+        return a->key < b->key ? -1 : 1;
+    if (!(a->key & 0xff))
+        return 0;
+    return strcmp(a->value + 8, b->value + 8);
+}
+
 /**
  * queue_contex_t - The context managing a chain of queues
  * @q: pointer to the head of the queue
@@ -78,6 +128,34 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_bulk() - Insert several elements at the head
+ * @head: header of queue
+ * @strings: array of strings would be inserted
+ * @n: number of strings
+ *
+ * Behaves like calling q_insert_head() on strings[0] .. strings[n - 1] in
+ * turn, so strings[n - 1] ends up at the head. All elements are allocated
+ * before the batch is spliced into the queue at once. A string whose
+ * allocation fails is skipped.
+ *
+ * Return: the number of elements inserted, 0 if queue is NULL
+ */
+int q_insert_head_bulk(struct list_head *head, char **strings, int n);
+
+/**
+ * q_insert_tail_bulk() - Insert several elements at the tail
+ * @head: header of queue
+ * @strings: array of strings would be inserted
+ * @n: number of strings
+ *
+ * Behaves like calling q_insert_tail() on strings[0] .. strings[n - 1] in
+ * turn, with the whole batch spliced in at once.
+ *
+ * Return: the number of elements inserted, 0 if queue is NULL
+ */
+int q_insert_tail_bulk(struct list_head *head, char **strings, int n);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -108,17 +186,60 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/**
+ * q_remove_head_n() - Remove up to n elements from head of queue
+ * @head: header of queue
+ * @out: list head receiving the removed elements
+ * @n: maximum number of elements to remove
+ * @buf: buffer for the removed strings, may be NULL
+ * @bufsize: size of @buf
+ * @offsets: where the offset of each string in @buf is stored, may be NULL
+ *
+ * The removed elements are detached at once and appended to @out in queue
+ * order. If buf is non-NULL, their strings are copied into it one after
+ * another, each with a null terminator, and offsets[i] receives the offset of
+ * the i-th string. Strings are truncated so that buf never overflows; once it
+ * is full, the remaining offsets point at its last terminator.
+ *
+ * As with q_remove_head(), the elements are unlinked but not freed.
+ *
+ * Return: the number of elements removed, 0 if queue is NULL or empty.
+ */
+int q_remove_head_n(struct list_head *head,
+                    struct list_head *out,
+                    int n,
+                    char *buf,
+                    size_t bufsize,
+                    size_t *offsets);
+
+/**
+ * q_remove_tail_n() - Remove up to n elements from tail of queue
+ * @head: header of queue
+ * @out: list head receiving the removed elements
+ * @n: maximum number of elements to remove
+ * @buf: buffer for the removed strings, may be NULL
+ * @bufsize: size of @buf
+ * @offsets: where the offset of each string in @buf is stored, may be NULL
+ *
+ * Same as q_remove_head_n(), except that the last n elements are removed.
+ * They are still appended to @out, and copied to @buf, in queue order.
+ *
+ * Return: the number of elements removed, 0 if queue is NULL or empty.
+ */
+int q_remove_tail_n(struct list_head *head,
+                    struct list_head *out,
+                    int n,
+                    char *buf,
+                    size_t bufsize,
+                    size_t *offsets);
+
 /**
  * q_release_element() - Release the element
  * @e: element would be released
  *
  * This function is intended for internal use only.
  */
-static inline void q_release_element(element_t *e)
-{
-    test_free(e->value);
-    test_free(e);
-}
+void q_release_element(element_t *e);
 
 /**
  * q_size() - Get the size of the queue
@@ -155,6 +276,21 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/**
+ * q_delete_dup_all() - Delete all nodes that have duplicate string, whether
+ *                      or not the duplicates are adjacent.
+ * @head: header of queue
+ *
+ * Unlike q_delete_dup(), the queue does not need to be sorted. Every value
+ * occurring more than once is removed in one pass over the queue, and the
+ * order of the remaining nodes is preserved. A hash table of the distinct
+ * values is allocated for the duration of the call.
+ *
+ * Return: true for success, false if list is NULL or the table could not be
+ * allocated.
+ */
+bool q_delete_dup_all(struct list_head *head);
+
 /**
  * q_swap() - Swap every two adjacent nodes
  * @head: header of queue
@@ -200,6 +336,20 @@ void q_reverseK(struct list_head *head, int k);
  */
 void q_sort(struct list_head *head, bool descend);
 
+/**
+ * q_sort_topk() - Move the k smallest or largest elements of queue to its
+ *                 front, in ascending/descending order
+ * @head: header of queue
+ * @k: number of elements to order
+ * @descend: whether or not to take the largest elements in descending order
+ *
+ * The first k elements end up as they would after q_sort(), while the order
+ * of the others is unspecified. If k is at least the size of the queue, the
+ * whole queue is sorted. No effect if queue is NULL or empty, or if k is not
+ * positive.
+ */
+void q_sort_topk(struct list_head *head, int k, bool descend);
+
 /**
  * q_ascend() - Remove every node which has a node with a strictly less
  * value anywhere to the right side of it.
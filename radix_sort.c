@@ -0,0 +1,69 @@
+#include "radix_sort.h"
+
+/* Buckets with at most this many nodes are sorted by list_sort() */
+#define RADIX_CUTOFF 32
+
+/* Deepest string position that is still bucketed. It bounds the recursion,
+ * and thus the 256 bucket heads kept on the stack per level.
+ */
+#define RADIX_MAX_DEPTH 16
+
+static void msd_sort(void *priv,
+                     struct list_head *head,
+                     list_cmp_func_t cmp,
+                     list_str_func_t str,
+                     bool descend,
+                     size_t depth)
+{
+    struct list_head buckets[256];
+    size_t count[256];
+    unsigned int lo = 255, hi = 0;
+
+    for (int c = 0; c < 256; c++) {
+        INIT_LIST_HEAD(&buckets[c]);
+        count[c] = 0;
+    }
+
+    struct list_head *node, *safe;
+    list_for_each_safe (node, safe, head) {
+        unsigned int c = (unsigned char) str(node)[depth];
+        list_move_tail(node, &buckets[c]);
+        count[c]++;
+        if (c < lo)
+            lo = c;
+        if (c > hi)
+            hi = c;
+    }
+
+    /* Strings which end at this position are equal, so bucket 0 needs no
+     * further work. It goes first in ascending order and last otherwise.
+     */
+    if (!descend)
+        list_splice_tail(&buckets[0], head);
+
+    for (unsigned int i = lo; i <= hi; i++) {
+        unsigned int c = descend ? hi + lo - i : i;
+        if (!c || !count[c])
+            continue;
+        if (count[c] > RADIX_CUTOFF && depth + 1 < RADIX_MAX_DEPTH)
+            msd_sort(priv, &buckets[c], cmp, str, descend, depth + 1);
+        else if (count[c] > 1)
+            list_sort(priv, &buckets[c], cmp);
+        list_splice_tail(&buckets[c], head);
+    }
+
+    if (descend)
+        list_splice_tail(&buckets[0], head);
+}
+
+void radix_sort(void *priv,
+                struct list_head *head,
+                list_cmp_func_t cmp,
+                list_str_func_t str,
+                bool descend)
+{
+    if (list_empty(head) || list_is_singular(head))
+        return;
+
+    msd_sort(priv, head, cmp, str, descend, 0);
+}
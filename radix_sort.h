@@ -0,0 +1,32 @@
+#ifndef LAB0_RADIXSORT_H
+#define LAB0_RADIXSORT_H
+
+#include <stdbool.h>
+
+#include "list.h"
+#include "list_sort.h"
+
+/* Return the null-terminated string a list node is keyed by */
+typedef const char *(*list_str_func_t)(const struct list_head *);
+
+/**
+ * radix_sort - MSD radix sort over a list of strings
+ * @priv: private data, opaque to radix_sort(), passed to @cmp
+ * @head: the list to sort
+ * @cmp: comparator used for small buckets, must agree with @descend
+ * @str: returns the string of a node
+ * @descend: whether to sort in descending order
+ *
+ * Nodes are distributed into one bucket per byte value with
+ * list_move_tail(), one string position at a time, and the buckets are
+ * concatenated again with list_splice_tail(). Buckets holding only a few
+ * nodes, or reached after a long common prefix, are handed to list_sort().
+ * The sort is stable.
+ */
+void radix_sort(void *priv,
+                struct list_head *head,
+                list_cmp_func_t cmp,
+                list_str_func_t str,
+                bool descend);
+
+#endif
@@ -1,6 +1,7 @@
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -184,7 +185,7 @@ static void fail_fun(const char *format, const char *msg)
 }
 
 /* Maximum number of megabytes that application can use (0 = unlimited) */
-static int mblimit = 0;
+int mblimit = 0;
 
 /* Keeping track of memory allocation */
 static size_t allocate_cnt = 0;
@@ -208,6 +209,14 @@ static void check_exceed(size_t new_bytes)
     }
 }
 
+size_t mem_available(void)
+{
+    if (mblimit <= 0)
+        return SIZE_MAX;
+    size_t limit_bytes = (size_t) mblimit << 20;
+    return limit_bytes > current_bytes ? limit_bytes - current_bytes : 0;
+}
+
 /* Call malloc & exit if fails */
 void *malloc_or_fail(size_t bytes, const char *fun_name)
 {
@@ -26,6 +26,12 @@ void report(int verblevel, char *fmt, ...);
 /* Like report, but without return character */
 void report_noreturn(int verblevel, char *fmt, ...);
 
+/* Maximum number of megabytes allocated through this interface (0 = none) */
+extern int mblimit;
+
+/* Bytes that can still be allocated under mblimit, SIZE_MAX if unlimited */
+size_t mem_available(void);
+
 /* Attempt to call malloc.  Fail when returns NULL */
 void *malloc_or_fail(size_t bytes, const char *fun_name);
 
@@ -0,0 +1,130 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+ring_t *ring_new(size_t capacity)
+{
+    /* Beyond this the rounding up would overflow */
+    if (capacity > (SIZE_MAX >> 1) + 1)
+        return NULL;
+
+    size_t cap = 2;
+    while (cap < capacity)
+        cap <<= 1;
+
+    ring_t *r = aligned_alloc(RING_CACHELINE, sizeof(ring_t));
+    if (!r)
+        return NULL;
+    r->slots = malloc(cap * sizeof(char *));
+    if (!r->slots) {
+        free(r);
+        return NULL;
+    }
+
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    r->tail_cache = 0;
+    r->head_cache = 0;
+    r->mask = cap - 1;
+    return r;
+}
+
+void ring_free(ring_t *r)
+{
+    if (!r)
+        return;
+
+    size_t head = atomic_load(&r->head), tail = atomic_load(&r->tail);
+    for (; head != tail; head++)
+        free(r->slots[head & r->mask]);
+    free(r->slots);
+    free(r);
+}
+
+/* Number of free slots as seen by the producer, refreshing its copy of the
+ * consumer index only when fewer than want slots seem free.
+ */
+static size_t ring_room(ring_t *r, size_t tail, size_t want)
+{
+    size_t room = r->mask + 1 - (tail - r->head_cache);
+    if (room < want) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        room = r->mask + 1 - (tail - r->head_cache);
+    }
+    return room;
+}
+
+/* Number of queued strings as seen by the consumer, refreshing its copy of
+ * the producer index only when fewer than want seem queued.
+ */
+static size_t ring_avail(ring_t *r, size_t head, size_t want)
+{
+    size_t avail = r->tail_cache - head;
+    if (avail < want) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        avail = r->tail_cache - head;
+    }
+    return avail;
+}
+
+int ring_insert_tail_n(ring_t *r, char **strings, int n)
+{
+    if (!r || n <= 0)
+        return 0;
+
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t room = ring_room(r, tail, n);
+    int cnt = 0;
+    for (; cnt < n && (size_t) cnt < room; cnt++) {
+        char *s = strdup(strings[cnt]);
+        if (!s)
+            break;
+        r->slots[(tail + cnt) & r->mask] = s;
+    }
+    if (cnt)
+        atomic_store_explicit(&r->tail, tail + cnt, memory_order_release);
+    return cnt;
+}
+
+bool ring_insert_tail(ring_t *r, const char *s)
+{
+    char *str = (char *) s;
+    return ring_insert_tail_n(r, &str, 1) == 1;
+}
+
+int ring_remove_head_n(ring_t *r, char **out, int n)
+{
+    if (!r || n <= 0)
+        return 0;
+
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t avail = ring_avail(r, head, n);
+    int cnt = 0;
+    for (; cnt < n && (size_t) cnt < avail; cnt++)
+        out[cnt] = r->slots[(head + cnt) & r->mask];
+    if (cnt)
+        atomic_store_explicit(&r->head, head + cnt, memory_order_release);
+    return cnt;
+}
+
+char *ring_remove_head(ring_t *r, char *sp, size_t bufsize)
+{
+    char *s;
+    if (ring_remove_head_n(r, &s, 1) != 1)
+        return NULL;
+
+    if (sp && bufsize) {
+        strncpy(sp, s, bufsize - 1);
+        sp[bufsize - 1] = '\0';
+    }
+    return s;
+}
+
+size_t ring_size(ring_t *r)
+{
+    if (!r)
+        return 0;
+    return atomic_load(&r->tail) - atomic_load(&r->head);
+}
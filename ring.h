@@ -0,0 +1,109 @@
+#ifndef LAB0_RING_H
+#define LAB0_RING_H
+
+/* Single-producer, single-consumer ring buffer
+ *
+ * A bounded FIFO of strings for one producer thread and one consumer
+ * thread. Capacity is a power of two, so indices wrap with a mask. The
+ * consumer index and the producer index live on separate cache lines, and
+ * each side keeps a private copy of the other side's index, re-reading the
+ * shared one only when the copy says the ring is full or empty. The batched
+ * calls publish a whole batch with a single index update.
+ *
+ * Strings are owned by the ring while queued and allocated with the system
+ * allocator.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RING_CACHELINE 64
+
+typedef struct {
+    /* Written by the consumer */
+    _Alignas(RING_CACHELINE) atomic_size_t head;
+    size_t tail_cache;
+
+    /* Written by the producer */
+    _Alignas(RING_CACHELINE) atomic_size_t tail;
+    size_t head_cache;
+
+    /* Read-only after ring_new() */
+    _Alignas(RING_CACHELINE) size_t mask;
+    char **slots;
+} ring_t;
+
+/**
+ * ring_new() - Create an empty ring
+ * @capacity: minimum number of strings the ring holds, rounded up to a power
+ *            of two
+ *
+ * Return: NULL for allocation failed, or @capacity too large to round up
+ */
+ring_t *ring_new(size_t capacity);
+
+/**
+ * ring_free() - Free the ring and the strings still queued in it
+ * @r: ring to free, neither side may still be using it
+ */
+void ring_free(ring_t *r);
+
+/**
+ * ring_insert_tail() - Insert a copy of @s at the tail, producer only
+ * @r: ring
+ * @s: string to be copied and inserted
+ *
+ * Return: true for success, false if the ring is full or allocation failed
+ */
+bool ring_insert_tail(ring_t *r, const char *s);
+
+/**
+ * ring_insert_tail_n() - Insert copies of up to @n strings, producer only
+ * @r: ring
+ * @strings: strings to be copied and inserted, in order
+ * @n: number of strings
+ *
+ * All inserted strings become visible to the consumer at once.
+ *
+ * Return: the number of strings inserted, fewer than @n if the ring filled
+ * up or an allocation failed
+ */
+int ring_insert_tail_n(ring_t *r, char **strings, int n);
+
+/**
+ * ring_remove_head() - Remove the string at the head, consumer only
+ * @r: ring
+ * @sp: string would be inserted
+ * @bufsize: size of the string
+ *
+ * If sp is non-NULL and a string is removed, copy it to *sp, up to a
+ * maximum of bufsize-1 characters, plus a null terminator.
+ *
+ * Return: the removed string, which the caller frees with free(), %NULL if
+ * the ring is empty
+ */
+char *ring_remove_head(ring_t *r, char *sp, size_t bufsize);
+
+/**
+ * ring_remove_head_n() - Remove up to @n strings from the head, consumer
+ * only
+ * @r: ring
+ * @out: receives the removed strings in queue order, freed by the caller
+ * @n: maximum number of strings to remove
+ *
+ * The slots are handed back to the producer at once.
+ *
+ * Return: the number of strings removed
+ */
+int ring_remove_head_n(ring_t *r, char **out, int n);
+
+/**
+ * ring_size() - Get the number of strings in the ring
+ * @r: ring
+ *
+ * Return: the number of queued strings, as seen by the calling side
+ */
+size_t ring_size(ring_t *r);
+
+#endif /* LAB0_RING_H */
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "timsort.h"
 
 static inline size_t run_size(struct list_head *head)
@@ -23,15 +25,14 @@ int list_length(struct list_head *head)
     return count;
 }
 
-static size_t find_minrun(struct list_head *head)
+static size_t find_minrun(size_t len)
 {
-    size_t len = list_length(head);
-
-    // find first 6 bit & add up remain bits
+    /* Take the first 6 bits, plus one if any remaining bit is set, so that
+     * minrun stays within 32 .. 64 */
     size_t minrun = 0;
 
     while (len >> 6) {
-        minrun += (len & 1);
+        minrun |= (len & 1);
         len >>= 1;
     }
 
@@ -44,37 +45,61 @@ struct pair {
     struct list_head *head, *next;
 };
 
-static size_t stk_size, minrun, runs;
-
-static struct list_head *merge(void *priv,
-                               list_cmp_func_t cmp,
-                               struct list_head *a,
-                               struct list_head *b)
+/* Return the last node of the sorted run list which goes before key in a
+ * stable merge, or NULL if list->head already goes after it. Nodes equal to
+ * key count as before it only if take_equal is set, that is, if list is the
+ * earlier run. Probing at distances 1, 2, 4, ... and then bisecting takes
+ * O(log k) comparisons for k such nodes, though the walk is still O(k).
+ * *count receives k.
+ */
+static struct list_head *gallop(void *priv,
+                                list_cmp_func_t cmp,
+                                struct list_head *list,
+                                struct list_head *key,
+                                bool take_equal,
+                                size_t *count)
 {
-    struct list_head *head = NULL;
-    struct list_head **tail = &head;
+#define BEFORE(node) \
+    (take_equal ? cmp(priv, node, key) <= 0 : cmp(priv, key, node) > 0)
+
+    *count = 0;
+    if (!BEFORE(list))
+        return NULL;
 
+    struct list_head *lo = list, *probe;
+    size_t gap = 1, dist;
+    *count = 1;
     for (;;) {
-        /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
-            *tail = a;
-            tail = &(*tail)->next;
-            a = a->next;
-            if (!a) {
-                *tail = b;
-                break;
-            }
+        probe = lo;
+        for (dist = 0; dist < gap && probe->next; dist++)
+            probe = probe->next;
+        if (!dist)
+            return lo;
+        if (!BEFORE(probe))
+            break;
+        lo = probe;
+        *count += dist;
+        if (dist < gap)
+            return lo;
+        gap <<= 1;
+    }
+
+    /* The answer lies in [lo, probe), dist nodes apart */
+    while (dist > 1) {
+        size_t half = dist / 2;
+        struct list_head *mid = lo;
+        for (size_t i = 0; i < half; i++)
+            mid = mid->next;
+        if (BEFORE(mid)) {
+            lo = mid;
+            *count += half;
+            dist -= half;
         } else {
-            *tail = b;
-            tail = &(*tail)->next;
-            b = b->next;
-            if (!b) {
-                *tail = a;
-                break;
-            }
+            dist = half;
         }
     }
-    return head;
+    return lo;
+#undef BEFORE
 }
 
 static void build_prev_link(struct list_head *head,
@@ -93,45 +118,128 @@ static void build_prev_link(struct list_head *head,
     head->prev = tail;
 }
 
-static void merge_final(void *priv,
-                        list_cmp_func_t cmp,
-                        struct list_head *head,
-                        struct list_head *a,
-                        struct list_head *b)
+/* Append the nodes first..last, already linked through next, after *tail.
+ * For the final merge, head is set and the prev links are rebuilt as well.
+ */
+static inline void append(struct list_head *head,
+                          struct list_head **tail,
+                          struct list_head *first,
+                          struct list_head *last)
 {
-    struct list_head *tail = head;
+    (*tail)->next = first;
+    if (head) {
+        first->prev = *tail;
+        while (first != last) {
+            first->next->prev = first;
+            first = first->next;
+        }
+    }
+    *tail = last;
+}
+
+/* Stable merge of two null-terminated runs, a before b. Once one side wins
+ * ctx->min_gallop times in a row, switch to galloping as CPython's listsort
+ * does, and adapt the threshold to how well galloping pays off.
+ *
+ * With head NULL the result is returned null-terminated. Otherwise it is the
+ * final merge: the result is hung off head as a circular doubly-linked list.
+ */
+static struct list_head *merge(void *priv,
+                               list_cmp_func_t cmp,
+                               struct list_head *head,
+                               struct list_head *a,
+                               struct list_head *b,
+                               struct timsort_ctx *ctx)
+{
+    struct list_head dummy, *tail = head ? head : &dummy;
+    size_t min_gallop = ctx->min_gallop;
 
     for (;;) {
-        /* if equal, take 'a' -- important for sort stability */
-        if (cmp(priv, a, b) <= 0) {
-            tail->next = a;
-            a->prev = tail;
-            tail = a;
-            a = a->next;
-            if (!a)
-                break;
-        } else {
-            tail->next = b;
-            b->prev = tail;
-            tail = b;
+        size_t wins_a = 0, wins_b = 0;
+
+        /* One pair at a time until a side wins min_gallop times in a row */
+        do {
+            /* if equal, take 'a' -- important for sort stability */
+            if (cmp(priv, a, b) <= 0) {
+                append(head, &tail, a, a);
+                a = a->next;
+                if (!a)
+                    goto done;
+                wins_a++;
+                wins_b = 0;
+            } else {
+                append(head, &tail, b, b);
+                b = b->next;
+                if (!b)
+                    goto done;
+                wins_b++;
+                wins_a = 0;
+            }
+        } while ((wins_a | wins_b) < min_gallop);
+
+        /* Gallop until neither side wins MIN_GALLOP nodes at once */
+        min_gallop++;
+        do {
+            min_gallop -= min_gallop > 1;
+
+            struct list_head *last = gallop(priv, cmp, a, b, true, &wins_a);
+            if (last) {
+                append(head, &tail, a, last);
+                a = last->next;
+                if (!a)
+                    goto done;
+            }
+            /* a now goes after b, no need to compare */
+            append(head, &tail, b, b);
             b = b->next;
-            if (!b) {
-                b = a;
-                break;
+            if (!b)
+                goto done;
+
+            last = gallop(priv, cmp, b, a, false, &wins_b);
+            if (last) {
+                append(head, &tail, b, last);
+                b = last->next;
+                if (!b)
+                    goto done;
             }
-        }
+            /* b now goes after a */
+            append(head, &tail, a, a);
+            a = a->next;
+            if (!a)
+                goto done;
+        } while (wins_a >= MIN_GALLOP || wins_b >= MIN_GALLOP);
+
+        /* Galloping stopped paying off, make it harder to enter again */
+        min_gallop++;
     }
 
-    /* Finish linking remainder of list b on to tail */
-    build_prev_link(head, tail, b);
+done:
+    ctx->min_gallop = min_gallop;
+    if (!head) {
+        tail->next = a ? a : b;
+        return dummy.next;
+    }
+
+    /* Finish linking remainder of the list on to tail */
+    build_prev_link(head, tail, a ? a : b);
+    return head->next;
 }
 
+/* Upper bound of minrun, see find_minrun() */
+#define MAX_MINRUN 64
+
+/* Detach the next run from list. A natural run is taken whole, reversing a
+ * strictly descending one on the fly. A run shorter than minrun is extended
+ * by binary insertion: its nodes are gathered into an array, each following
+ * node is placed with O(log minrun) comparisons, and the array is relinked.
+ */
 static struct pair find_run(void *priv,
                             struct list_head *list,
-                            list_cmp_func_t cmp)
+                            list_cmp_func_t cmp,
+                            struct timsort_ctx *ctx)
 {
     size_t len = 1;
-    struct list_head *next = list->next, *head = list, **ptr = &head;
+    struct list_head *next = list->next, *head = list;
     struct pair result;
 
     if (!next) {
@@ -139,32 +247,55 @@ static struct pair find_run(void *priv,
         return result;
     }
 
-    while (len < minrun && next) {
-        if (cmp(priv, list, next) > 0) {
-            /* decending run, also reverse the list */
-            do {
-                if (cmp(priv, *ptr, next) > 0) {
-                    len++;
-                    list->next = next->next;
-                    next->next = *ptr;
-                    *ptr = next;
-                    next = list->next;
-                    ptr = &head;
-                } else
-                    ptr = &(*ptr)->next;
-            } while (next && cmp(priv, list, next) > 0 && len < minrun);
-        } else {
-            do {
-                len++;
-                list = next;
-                next = list->next;
-            } while (next && cmp(priv, list, next) <= 0 && len < minrun);
+    if (cmp(priv, list, next) > 0) {
+        /* decending run, also reverse the list */
+        do {
+            struct list_head *tmp = next->next;
+            next->next = head;
+            head = next;
+            next = tmp;
+            len++;
+        } while (next && cmp(priv, head, next) > 0);
+    } else {
+        do {
+            len++;
+            list = next;
+            next = list->next;
+        } while (next && cmp(priv, list, next) <= 0);
+    }
+
+    if (len < ctx->minrun && next) {
+        struct list_head *run[MAX_MINRUN], *node = head;
+        for (size_t i = 0; i < len; i++, node = node->next)
+            run[i] = node;
+
+        while (len < ctx->minrun && next) {
+            node = next;
+            next = next->next;
+
+            /* Insert after all equal nodes to keep the sort stable */
+            size_t lo = 0, hi = len;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (cmp(priv, run[mid], node) <= 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            memmove(&run[lo + 1], &run[lo], (len - lo) * sizeof(*run));
+            run[lo] = node;
+            len++;
         }
+
+        for (size_t i = 0; i + 1 < len; i++)
+            run[i]->next = run[i + 1];
+        head = run[0];
+        list = run[len - 1];
     }
 
     list->next = NULL;
     head->prev = NULL;
-    runs++;
+    ctx->runs++;
     head->next->prev = (struct list_head *) len;
     result.head = head, result.next = next;
     return result;
@@ -172,26 +303,28 @@ static struct pair find_run(void *priv,
 
 static struct list_head *merge_at(void *priv,
                                   list_cmp_func_t cmp,
-                                  struct list_head *at)
+                                  struct list_head *at,
+                                  struct timsort_ctx *ctx)
 {
     size_t len = run_size(at) + run_size(at->prev);
     struct list_head *prev = at->prev->prev;
-    struct list_head *list = merge(priv, cmp, at->prev, at);
+    struct list_head *list = merge(priv, cmp, NULL, at->prev, at, ctx);
     list->prev = prev;
     list->next->prev = (struct list_head *) len;
-    --stk_size;
+    --ctx->stk_size;
     return list;
 }
 
 static struct list_head *merge_force_collapse(void *priv,
                                               list_cmp_func_t cmp,
-                                              struct list_head *tp)
+                                              struct list_head *tp,
+                                              struct timsort_ctx *ctx)
 {
-    while (stk_size >= 3) {
+    while (ctx->stk_size >= 3) {
         if (run_size(tp->prev->prev) < run_size(tp)) {
-            tp->prev = merge_at(priv, cmp, tp->prev);
+            tp->prev = merge_at(priv, cmp, tp->prev, ctx);
         } else {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, ctx);
         }
     }
     return tp;
@@ -199,21 +332,22 @@ static struct list_head *merge_force_collapse(void *priv,
 
 static struct list_head *merge_collapse(void *priv,
                                         list_cmp_func_t cmp,
-                                        struct list_head *tp)
+                                        struct list_head *tp,
+                                        struct timsort_ctx *ctx)
 {
     int n;
-    while ((n = stk_size) >= 2) {
+    while ((n = ctx->stk_size) >= 2) {
         if ((n >= 3 &&
              run_size(tp->prev->prev) <= run_size(tp->prev) + run_size(tp)) ||
             (n >= 4 && run_size(tp->prev->prev->prev) <=
                            run_size(tp->prev->prev) + run_size(tp->prev))) {
             if (run_size(tp->prev->prev) < run_size(tp)) {
-                tp->prev = merge_at(priv, cmp, tp->prev);
+                tp->prev = merge_at(priv, cmp, tp->prev, ctx);
             } else {
-                tp = merge_at(priv, cmp, tp);
+                tp = merge_at(priv, cmp, tp, ctx);
             }
         } else if (run_size(tp->prev) <= run_size(tp)) {
-            tp = merge_at(priv, cmp, tp);
+            tp = merge_at(priv, cmp, tp, ctx);
         } else {
             break;
         }
@@ -222,11 +356,16 @@ static struct list_head *merge_collapse(void *priv,
     return tp;
 }
 
-void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+void timsort_n_r(void *priv,
+                 struct list_head *head,
+                 list_cmp_func_t cmp,
+                 size_t len,
+                 struct timsort_ctx *ctx)
 {
-    stk_size = 0;
-    runs = 0;
-    minrun = find_minrun(head);
+    ctx->stk_size = 0;
+    ctx->runs = 0;
+    ctx->min_gallop = MIN_GALLOP;
+    ctx->minrun = find_minrun(len);
 
     struct list_head *list = head->next, *tp = NULL;
     if (head == head->prev)
@@ -237,26 +376,48 @@ void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
 
     do {
         /* Find next run */
-        struct pair result = find_run(priv, list, cmp);
+        struct pair result = find_run(priv, list, cmp, ctx);
         result.head->prev = tp;
         tp = result.head;
         list = result.next;
-        stk_size++;
-        tp = merge_collapse(priv, cmp, tp);
+        ctx->stk_size++;
+        tp = merge_collapse(priv, cmp, tp, ctx);
     } while (list);
-    // printf("minrun : %ld\n", minrun);
-    // printf("runs : %ld\n", runs);
+    // printf("minrun : %ld\n", ctx->minrun);
+    // printf("runs : %ld\n", ctx->runs);
 
     /* End of input; merge together all the runs. */
-    tp = merge_force_collapse(priv, cmp, tp);
+    tp = merge_force_collapse(priv, cmp, tp, ctx);
 
     /* The final merge; rebuild prev links */
     struct list_head *stk0 = tp, *stk1 = stk0->prev;
     while (stk1 && stk1->prev)
         stk0 = stk0->prev, stk1 = stk1->prev;
-    if (stk_size <= 1) {
+    if (ctx->stk_size <= 1) {
         build_prev_link(head, head, stk0);
         return;
     }
-    merge_final(priv, cmp, head, stk1, stk0);
-}
\ No newline at end of file
+    merge(priv, cmp, head, stk1, stk0, ctx);
+}
+
+void timsort_r(void *priv,
+               struct list_head *head,
+               list_cmp_func_t cmp,
+               struct timsort_ctx *ctx)
+{
+    timsort_n_r(priv, head, cmp, list_length(head), ctx);
+}
+
+void timsort_n(void *priv,
+               struct list_head *head,
+               list_cmp_func_t cmp,
+               size_t len)
+{
+    struct timsort_ctx ctx;
+    timsort_n_r(priv, head, cmp, len, &ctx);
+}
+
+void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp)
+{
+    timsort_n(priv, head, cmp, list_length(head));
+}
@@ -1,3 +1,7 @@
+#ifndef LAB0_TIMSORT_H
+#define LAB0_TIMSORT_H
+
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,4 +11,36 @@ typedef int (*list_cmp_func_t)(void *,
                                const struct list_head *,
                                const struct list_head *);
 
-void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp);
\ No newline at end of file
+/* Initial number of consecutive wins before a merge starts galloping */
+#define MIN_GALLOP 7
+
+/* Per-call state of timsort, so that concurrent sorts do not interfere */
+struct timsort_ctx {
+    size_t stk_size; /* Number of runs on the stack */
+    size_t minrun;
+    size_t runs;       /* Number of runs found */
+    size_t min_gallop; /* Adaptive galloping threshold */
+};
+
+/* Sort using the caller-provided context, safe to call from many threads */
+void timsort_r(void *priv,
+               struct list_head *head,
+               list_cmp_func_t cmp,
+               struct timsort_ctx *ctx);
+
+/* Sort a list known to hold len nodes, which saves walking it to compute
+ * minrun. The _r variant takes a caller-provided context as timsort_r().
+ */
+void timsort_n(void *priv,
+               struct list_head *head,
+               list_cmp_func_t cmp,
+               size_t len);
+void timsort_n_r(void *priv,
+                 struct list_head *head,
+                 list_cmp_func_t cmp,
+                 size_t len,
+                 struct timsort_ctx *ctx);
+
+void timsort(void *priv, struct list_head *head, list_cmp_func_t cmp);
+
+#endif
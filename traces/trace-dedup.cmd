@@ -0,0 +1,21 @@
+# Test of 'dedup all' on non-adjacent duplicates and degenerate queues
+option fail 0
+option malloc 0
+new
+dedup all
+ih a
+dedup all
+ih b
+ih a
+ih c
+ih b
+ih a
+ih d
+dedup all
+it e
+it c
+it e
+it f
+dedup all
+free
+quit
@@ -0,0 +1,16 @@
+# Test of extsort spilling sorted runs to disk under a low mblimit
+option fail 0
+option malloc 0
+option mblimit 1
+new
+# Far more than the 512 KiB chunks, so the runs need two levels of merging
+ih RAND 250000
+extsort
+option descend 1
+extsort
+it aaa
+it zzz
+it aaa
+extsort
+free
+quit
@@ -0,0 +1,15 @@
+# Test of timsort at sizes whose minrun is at its upper bound of 64
+option fail 0
+option malloc 0
+new
+it RAND 255
+sort timsort
+free
+new
+it RAND 4095
+sort timsort
+option descend 1
+it RAND 4095
+sort timsort
+free
+quit
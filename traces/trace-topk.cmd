@@ -0,0 +1,24 @@
+# Test of partial sorting with 'sort k'
+option fail 0
+option malloc 0
+new
+ih RAND 50
+# k must be positive, so this reports an error
+sort 0
+sort 1
+sort 7
+sort 50
+ih RAND 20
+sort 100
+option descend 1
+ih RAND 30
+sort 1
+sort 9
+sort 100
+free
+new
+sort 3
+ih a
+sort 3
+free
+quit